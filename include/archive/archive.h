@@ -21,17 +21,29 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #ifndef ARCHIVE_H
 #define ARCHIVE_H
 
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <filesystem>
 #include <functional>
+#include <iosfwd>
 #include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "generator.h"
 
 #ifdef __unix__
-using native_string = std::string;
+using native_string      = std::string;
+using native_string_view = std::string_view;
 #define EXPORT __attribute__((visibility("default")))
 #define IMPORT
 #else
-using native_string = std::wstring;
+using native_string      = std::wstring;
+using native_string_view = std::wstring_view;
 #define EXPORT __declspec(dllexport)
 #define IMPORT __declspec(dllimport)
 #endif
@@ -53,6 +65,22 @@ public:
    */
   virtual std::filesystem::path getArchiveFilePath() const = 0;
 
+  /**
+   * @return the path of this entry in the archive, like getArchiveFilePath() but
+   *   without copying it. The view remains valid until the archive is closed.
+   */
+  virtual native_string_view getArchiveFilePathView() const = 0;
+
+  /**
+   * @return the path of this entry for case-insensitive comparisons: '/' separators,
+   *   no leading or trailing separator and case folded. Folding does not depend on
+   *   the locale and covers ASCII, the Latin-1, Latin Extended-A, Greek and Cyrillic
+   *   letters and the fullwidth Latin letters; other characters are compared as is.
+   *   Keys are computed once for all the entries and remain valid until the archive
+   *   is closed.
+   */
+  virtual native_string_view getPathKey() const = 0;
+
   /**
    * @return the size of this entry in bytes (uncompressed).
    */
@@ -89,9 +117,419 @@ public:
    */
   virtual bool isDirectory() const = 0;
 
+  /// value of getBlockIndex() for entries outside of any solid block
+  static constexpr uint32_t NO_BLOCK = UINT32_MAX;
+
+  /**
+   * @return the size of this entry in the archive (compressed), 0 if unknown. Entries
+   *   of a solid block usually only report the packed size on the first entry.
+   */
+  virtual uint64_t getPackedSize() const = 0;
+
+  /**
+   * @return the modification time of this entry, the epoch if unknown.
+   */
+  virtual std::chrono::system_clock::time_point getModificationTime() const = 0;
+
+  /**
+   * @return the attributes of this entry, as stored in the archive (Windows attributes,
+   *   with the Unix mode in the high 16 bits for some formats).
+   */
+  virtual uint32_t getAttributes() const = 0;
+
+  /**
+   * @return the compression method of this entry (e.g. "LZMA2:24"), empty if unknown.
+   *   The view remains valid until the archive is closed.
+   */
+  virtual native_string_view getCompressionMethod() const = 0;
+
+  /**
+   * @return true if the content of this entry is encrypted, false otherwize.
+   */
+  virtual bool isEncrypted() const = 0;
+
+  /**
+   * @return the index of the solid block (folder) this entry is stored in, NO_BLOCK if
+   *   the entry is not part of a block. Entries of the same block must be decoded in
+   *   order, from the start of the block.
+   */
+  virtual uint32_t getBlockIndex() const = 0;
+
   virtual ~FileData() = default;
 };
 
+/**
+ * @brief Interface used by archives to schedule their internal work (writing extracted
+ *   data, hashing, ...).
+ *
+ * Host applications can implement this interface to run these tasks on their own task
+ * system, or use CreateThreadPoolExecutor() to get a built-in pool.
+ */
+class Executor
+{
+public:
+  using Task = std::function<void()>;
+
+  /**
+   * @brief Schedule the given task for execution.
+   *
+   * Tasks may run on any thread, including the calling one, and must all have been run
+   * before the executor is destroyed.
+   *
+   * @param task The task to run.
+   */
+  virtual void submit(Task task) = 0;
+
+  /**
+   * @return the maximum number of tasks this executor runs concurrently.
+   */
+  virtual std::size_t concurrency() const = 0;
+
+  virtual ~Executor() = default;
+};
+
+/**
+ * @brief Random-access source of archive data, see Archive::open().
+ *
+ * Reads are made from the thread using the archive, one at a time.
+ */
+class InputStream
+{
+public:
+  /**
+   * @return the size of the data in bytes.
+   */
+  virtual uint64_t size() const = 0;
+
+  /**
+   * @brief Read bytes at the given offset.
+   *
+   * @param offset Offset of the first byte to read.
+   * @param buffer Buffer to read to.
+   *
+   * @return the number of bytes read, which is less than the size of the buffer only
+   *   at the end of the data or if an error occurred.
+   */
+  virtual std::size_t read(uint64_t offset, std::span<std::byte> buffer) = 0;
+
+  virtual ~InputStream() = default;
+};
+
+/**
+ * @brief Directory tree of the entries of an archive, see Archive::getTree().
+ */
+struct ArchiveTree
+{
+  // index of a missing node
+  static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+  struct Node
+  {
+    // name of the file or directory, points into the path of an entry so it is valid
+    // until the archive is closed, empty for the root
+    native_string_view name;
+
+    // entry of this node, null for the root and for directories that only appear in
+    // the paths of other entries
+    FileData* entry = nullptr;
+
+    uint32_t parent      = NO_NODE;
+    uint32_t firstChild  = NO_NODE;
+    uint32_t nextSibling = NO_NODE;
+
+    bool isDirectory = false;
+
+    // total uncompressed size of the files in the subtree of this node
+    uint64_t size = 0;
+
+    // number of files in the subtree of this node
+    uint32_t fileCount = 0;
+  };
+
+  // nodes of the tree, the root is the first one, and parents always come before their
+  // children
+  std::vector<Node> nodes;
+};
+
+/**
+ * @brief Readable stream over the decoded content of an archive entry, see
+ *   Archive::openEntry().
+ *
+ * The content is decoded on demand by a background thread, only a bounded amount of
+ * data is buffered ahead of the reader.
+ */
+class EntryStream
+{
+public:
+  /**
+   * @brief Read the next bytes of the entry, waiting for them to be decoded.
+   *
+   * @param buffer Buffer to read to.
+   *
+   * @return the number of bytes read, which is less than the size of the buffer only
+   *   at the end of the entry or if an error occurred.
+   */
+  virtual std::size_t read(std::span<std::byte> buffer) = 0;
+
+  /**
+   * @return true if an error occurred while decoding the entry, false otherwise.
+   */
+  virtual bool failed() const = 0;
+
+  /**
+   * @return a std::istream reading from this stream.
+   */
+  virtual std::istream& stream() = 0;
+
+  virtual ~EntryStream() = default;
+};
+
+/**
+ * @brief Output paths of many entries, given at once to Archive::extract() instead of
+ *   calling FileData::addOutputFilePath() for each entry.
+ *
+ * Paths are front-coded: only the part of a path that differs from the previous one is
+ * stored, so adding paths sorted (e.g. in the order of the file list) keeps large
+ * mappings small. An entry can be given several paths.
+ */
+class OutputMapping
+{
+public:
+  /**
+   * @brief Reserve space for the given number of paths.
+   */
+  void reserve(std::size_t count) { m_Items.reserve(count); }
+
+  /**
+   * @brief Add an output path for an entry.
+   *
+   * @param index Index of the entry in Archive::getFileList().
+   * @param path Path to extract the entry to, relative to the output directory.
+   */
+  void add(uint32_t index, native_string_view path)
+  {
+    std::size_t shared = 0;
+    while (shared < path.size() && shared < m_Last.size() &&
+           path[shared] == m_Last[shared]) {
+      ++shared;
+    }
+
+    m_Items.push_back({index, static_cast<uint32_t>(shared),
+                       static_cast<uint32_t>(path.size())});
+    m_Suffixes.append(path.substr(shared));
+    m_Last.assign(path);
+  }
+
+  /**
+   * @brief Call the given function with the index and path of every mapping, in the
+   *   order they were added. The path is only valid during the call.
+   */
+  template <typename F>
+  void forEach(F&& f) const
+  {
+    native_string path;
+    std::size_t offset = 0;
+    for (const auto& item : m_Items) {
+      const std::size_t suffixSize = item.size - item.shared;
+      path.resize(item.shared);
+      path.append(m_Suffixes, offset, suffixSize);
+      offset += suffixSize;
+      f(item.index, native_string_view(path));
+    }
+  }
+
+  [[nodiscard]] std::size_t size() const { return m_Items.size(); }
+  [[nodiscard]] bool empty() const { return m_Items.empty(); }
+
+  void clear()
+  {
+    m_Items.clear();
+    m_Suffixes.clear();
+    m_Last.clear();
+  }
+
+private:
+  struct Item
+  {
+    uint32_t index;
+    // length of the prefix shared with the previous path
+    uint32_t shared;
+    uint32_t size;
+  };
+
+  std::vector<Item> m_Items;
+  native_string m_Suffixes;
+
+  // last path added, to compute the shared prefix of the next one
+  native_string m_Last;
+};
+
+/// @brief Rule of a PathRules set.
+///
+/// Patterns are matched against whole entry paths, using '/' as separator:
+/// - `*` matches any sequence of characters inside of a path component,
+/// - `?` matches a single character other than a separator,
+/// - `**` matches any sequence of characters, separators included, and must be a
+///   whole path component; `**/` also matches nothing, so `**/*.esp` matches `a.esp`
+///   and `x/y/a.esp`.
+///
+/// Each wildcard of the replacement is replaced by the text matched by the pattern
+/// wildcard of the same kind and rank, e.g. mapping `*/Data/**` to `**` strips the
+/// first directory and the Data directory below it.
+struct PathRule
+{
+  enum class Action
+  {
+    // extract matching entries to the replacement path
+    MAP,
+
+    // do not extract matching entries
+    SKIP
+  };
+
+  Action action = Action::MAP;
+  native_string pattern;
+
+  // output path for MAP rules, ignored for SKIP rules
+  native_string replacement;
+};
+
+/**
+ * @brief Compiled set of PathRule, see CompilePathRules().
+ *
+ * Rules are tried in order and the first matching one applies. A set can be shared by
+ * several threads.
+ */
+class PathRules
+{
+public:
+  enum class Result
+  {
+    // no rule matches the path
+    NO_MATCH,
+
+    // the first matching rule is a SKIP rule
+    SKIPPED,
+
+    // the first matching rule is a MAP rule
+    MAPPED
+  };
+
+  /**
+   * @brief Working memory of apply(), kept between calls so that applying the rules
+   *   to many paths does not allocate for each of them.
+   */
+  struct Buffers
+  {
+    std::vector<uint32_t> candidates;
+    std::vector<std::pair<std::size_t, std::size_t>> captures;
+    std::vector<bool> failed;
+  };
+
+  /**
+   * @brief Apply the rules to the given path.
+   *
+   * @param path Path of an entry in the archive, separators can be '/' or '\'.
+   * @param output Set to the output path if the path is mapped.
+   * @param buffers Working memory, can be reused for the next paths.
+   *
+   * @return how the path was handled.
+   */
+  virtual Result apply(native_string_view path, native_string& output,
+                       Buffers& buffers) const = 0;
+
+  Result apply(native_string_view path, native_string& output) const
+  {
+    Buffers buffers;
+    return apply(path, output, buffers);
+  }
+
+  virtual ~PathRules() = default;
+};
+
+/**
+ * @brief Destination of the content extracted by Archive::extract().
+ *
+ * For each extracted entry, beginEntry() is called, then write() for every chunk of
+ * decoded data (none for directories and empty files), then endEntry(). Calls are made
+ * one at a time and in order, but not necessarily from the thread that called
+ * extract(). Returning false from any of these functions aborts the extraction.
+ */
+class OutputSink
+{
+public:
+  /**
+   * @brief Called before the content of the given entry is written.
+   *
+   * @param entry The entry being extracted.
+   *
+   * @return true to continue the extraction, false to abort it.
+   */
+  virtual bool beginEntry(FileData const& entry) = 0;
+
+  /**
+   * @brief Write the next chunk of decoded data of the given entry.
+   *
+   * @param entry The entry being extracted.
+   * @param data The decoded data, only valid during this call.
+   *
+   * @return true to continue the extraction, false to abort it.
+   */
+  virtual bool write(FileData const& entry, std::span<const std::byte> data) = 0;
+
+  /**
+   * @brief Called after the whole content of the given entry has been written.
+   *
+   * @param entry The entry that was extracted.
+   *
+   * @return true to continue the extraction, false to abort it.
+   */
+  virtual bool endEntry(FileData const& entry) = 0;
+
+  /**
+   * @return a description of the error that made this sink abort the extraction.
+   */
+  virtual native_string errorMessage() const { return {}; }
+
+  virtual ~OutputSink() = default;
+};
+
+/**
+ * Output sink keeping the extracted content in memory.
+ */
+class MemorySink : public OutputSink
+{
+public:
+  /**
+   * @param entry An entry of the archive.
+   *
+   * @return the content extracted for the given entry, or a null pointer if it was not
+   *   extracted to this sink.
+   */
+  virtual const std::vector<std::byte>* content(FileData const& entry) const = 0;
+};
+
+/**
+ * Output sink only computing the size and CRC32 of the extracted content.
+ */
+class HashSink : public OutputSink
+{
+public:
+  struct Hash
+  {
+    uint64_t size = 0;
+    uint32_t crc  = 0;
+  };
+
+  /**
+   * @param entry An entry of the archive.
+   *
+   * @return the hash of the content extracted for the given entry, or a null pointer
+   *   if it was not extracted to this sink.
+   */
+  virtual const Hash* hash(FileData const& entry) const = 0;
+};
+
 class Archive
 {
 public:  // Declarations
@@ -160,7 +598,100 @@ public:  // Declarations
     ERROR_INVALID_ARCHIVE_FORMAT,
     ERROR_LIBRARY_ERROR,
     ERROR_ARCHIVE_INVALID,
-    ERROR_OUT_OF_MEMORY
+    ERROR_OUT_OF_MEMORY,
+    ERROR_INVALID_OUTPUT_MAPPING
+  };
+
+  enum class PathMatch
+  {
+    // paths must be identical, apart from separators
+    EXACT,
+
+    // paths may differ by case
+    CASE_INSENSITIVE
+  };
+
+  enum class InputMode
+  {
+    // read the archive file through buffered reads
+    BUFFERED,
+
+    // map the archive file in memory, which avoids copies and makes seeks free, and is
+    // especially fast for archives that are already in the system cache
+    MEMORY_MAPPED,
+
+    // read the archive file ahead of 7z in the background, which keeps extraction from
+    // waiting on slow drives
+    PREFETCHED
+  };
+
+  /**
+   * Options for opening archive files. The first volume of a multi-volume archive is
+   * always read with buffered reads, and its listing is never cached.
+   */
+  struct OpenOptions
+  {
+    InputMode inputMode = InputMode::BUFFERED;
+
+    // size of the read-ahead window in bytes with InputMode::PREFETCHED, half of it is
+    // read by 7z while the other half is filled
+    std::size_t prefetchWindowSize = 8 * 1024 * 1024;
+
+    // build the directory tree while opening rather than on the first call to
+    // getTree()
+    bool buildTree = false;
+
+    // compute the keys of the entries (FileData::getPathKey()) and index them while
+    // opening rather than on the first lookup
+    bool indexPaths = false;
+
+    // directory where the listings of archives are cached, empty to disable the cache;
+    // archives found in the cache are listed without 7z, which is only loaded on the
+    // first extraction, and archives with encrypted headers are never cached; hits
+    // and the later loading of 7z are logged at the debug level
+    std::filesystem::path listingCacheDirectory;
+  };
+
+  /**
+   * Piece of the decoded content of an entry, see chunks().
+   */
+  struct EntryChunk
+  {
+    FileData* entry;
+
+    // points into the buffers of 7z, only valid until the next chunk is requested
+    std::span<const std::byte> data;
+  };
+
+  /**
+   * Statistics about the reads of the opened archive.
+   */
+  struct InputStats
+  {
+    // number of buffer refills served by data read ahead
+    uint64_t prefetchHits = 0;
+
+    // number of buffer refills that had to wait for the drive
+    uint64_t prefetchMisses = 0;
+  };
+
+  /**
+   * Limits applied to extractions to reduce their impact on other applications.
+   */
+  struct ExtractionLimits
+  {
+    // maximum number of bytes written per second (for all the output files), 0 for no
+    // limit
+    uint64_t writeBytesPerSecond = 0;
+
+    // maximum number of bytes decoded per second, 0 for no limit
+    uint64_t decodeBytesPerSecond = 0;
+
+    // decode on a thread with idle I/O priority and a lower CPU priority, and write
+    // with idle I/O priority - when set, the callbacks passed to extract() are called
+    // from that thread, which is created for the extraction rather than taken from the
+    // executor since its CPU priority cannot be raised back afterwards
+    bool lowPriority = false;
   };
 
 public:  // Special member functions:
@@ -193,6 +724,21 @@ public:
    */
   virtual void setLogCallback(LogCallback logCallback) = 0;
 
+  /**
+   * @brief Set the executor used to schedule the internal tasks of this archive.
+   *
+   * This must not be called during an extraction. To go back to the built-in pool, you
+   * can pass a null pointer.
+   *
+   * @param executor The new executor to use.
+   */
+  virtual void setExecutor(std::shared_ptr<Executor> executor) = 0;
+
+  /**
+   * @return the executor used to schedule the internal tasks of this archive.
+   */
+  virtual std::shared_ptr<Executor> getExecutor() const = 0;
+
   /**
    * @brief Open the given archive.
    *
@@ -206,6 +752,45 @@ public:
   virtual bool open(std::filesystem::path const& archivePath,
                     PasswordCallback passwordCallback) = 0;
 
+  /**
+   * @brief Open the given archive with the given options.
+   *
+   * @param archivePath Path to the archive to open.
+   * @param passwordCallback Callback to use to ask user for password, see the other
+   *   overload.
+   * @param options Options controlling how the archive is read.
+   *
+   * @return true if the archive was open properly, false otherwise.
+   */
+  virtual bool open(std::filesystem::path const& archivePath,
+                    PasswordCallback passwordCallback, OpenOptions const& options) = 0;
+
+  /**
+   * @brief Open the archive contained in the given buffer.
+   *
+   * @param data The content of the archive, which must remain valid until the archive
+   *   is closed.
+   * @param passwordCallback Callback to use to ask user for password, see the other
+   *   overload.
+   *
+   * @return true if the archive was open properly, false otherwise.
+   */
+  virtual bool open(std::span<const std::byte> data,
+                    PasswordCallback passwordCallback) = 0;
+
+  /**
+   * @brief Open the archive read from the given stream.
+   *
+   * @param stream The stream to read the archive from, kept until the archive is
+   *   closed.
+   * @param passwordCallback Callback to use to ask user for password, see the other
+   *   overload.
+   *
+   * @return true if the archive was open properly, false otherwise.
+   */
+  virtual bool open(std::shared_ptr<InputStream> stream,
+                    PasswordCallback passwordCallback) = 0;
+
   /**
    * @brief Close the currently opened archive.
    */
@@ -216,6 +801,75 @@ public:
    */
   virtual const std::vector<FileData*>& getFileList() const = 0;
 
+  /**
+   * @brief Find the entry with the given path.
+   *
+   * Both '/' and '\' are accepted as separators. The first call indexes the paths of
+   * all the entries, which makes the next lookups cheap.
+   *
+   * @param path Path of the entry in the archive.
+   * @param match How to compare paths.
+   *
+   * @return the entry, or a null pointer if there is none. If several entries have the
+   *   same path, the first one is returned.
+   */
+  virtual FileData* findEntry(std::filesystem::path const& path, PathMatch match) = 0;
+
+  /**
+   * @brief List the entries under the given directory, recursively.
+   *
+   * The directory itself is not included, and an empty path lists every entry. Like
+   * findEntry(), the first call indexes the paths of all the entries.
+   *
+   * @param directory Path of the directory in the archive.
+   * @param match How to compare paths.
+   *
+   * @return the entries, ordered by case-insensitive path.
+   */
+  virtual std::vector<FileData*> listPrefix(std::filesystem::path const& directory,
+                                            PathMatch match) = 0;
+
+  /**
+   * @brief Retrieve the directory tree of the entries of the archive.
+   *
+   * The tree is built on the first call, or while opening if requested in the
+   * OpenOptions, and remains valid until the archive is closed.
+   *
+   * @return the directory tree.
+   */
+  virtual ArchiveTree const& getTree() = 0;
+
+  /**
+   * @brief Find the entries that have the same path when case is ignored, which would
+   *   overwrite each other when extracted to a case-insensitive file system.
+   *
+   * Like findEntry(), the first call indexes the paths of all the entries.
+   *
+   * @return the groups of colliding entries, each in the order of the file list.
+   */
+  virtual std::vector<std::vector<FileData*>> getCaseCollisions() = 0;
+
+  /**
+   * @brief Apply the given rules to every entry, in a single pass.
+   *
+   * @param rules The rules to apply.
+   *
+   * @return the output paths of the entries mapped by the rules, to pass to
+   *   extract(outputDirectory, mapping, ...). Entries that are skipped, match no rule
+   *   or are mapped to an empty path are left out.
+   */
+  virtual OutputMapping mapEntries(PathRules const& rules) = 0;
+
+  /**
+   * @brief Select the entries mapped by the given rules.
+   *
+   * @param rules The rules to apply.
+   *
+   * @return the entries mapped by the rules to a non-empty path, in the order of the
+   *   file list; these are the entries of mapEntries(rules).
+   */
+  virtual std::vector<FileData*> selectEntries(PathRules const& rules) = 0;
+
   /**
    * @brief Extract the content of the archive.
    *
@@ -237,12 +891,152 @@ public:
                        FileChangeCallback fileChangeCallback,
                        ErrorCallback errorCallback) = 0;
 
+  /**
+   * @brief Extract the given entries to the given sink.
+   *
+   * The output file paths of the entries are only used by the sinks that need them
+   * (e.g. the one created by CreateDiskSink()) and are not cleared.
+   *
+   * @param entries Entries to extract, from the file list of this archive.
+   * @param sink Sink receiving the extracted content.
+   * @param progressCallback Function called to notify extraction progress.
+   * @param fileChangeCallback Function called when the file currently being extracted
+   * changes.
+   * @param errorCallback Function called when an error occurs.
+   *
+   * @return true if the entries were extracted, false otherwise.
+   */
+  virtual bool extract(std::span<FileData* const> entries, OutputSink& sink,
+                       ProgressCallback progressCallback,
+                       FileChangeCallback fileChangeCallback,
+                       ErrorCallback errorCallback) = 0;
+
+  /**
+   * @brief Extract entries to the paths given by a mapping.
+   *
+   * The mapping is checked as a whole before anything is extracted: every index must
+   * belong to the file list and every path must be relative and stay inside of the
+   * output directory. The output file paths of the entries are neither used nor
+   * cleared.
+   *
+   * @param outputDirectory Path to the directory where the entries should be
+   * extracted.
+   * @param mapping Entries to extract and their paths, relative to outputDirectory.
+   * @param progressCallback Function called to notify extraction progress.
+   * @param fileChangeCallback Function called when the file currently being extracted
+   * changes.
+   * @param errorCallback Function called when an error occurs.
+   *
+   * @return true if the entries were extracted, false otherwise.
+   */
+  virtual bool extract(std::filesystem::path const& outputDirectory,
+                       OutputMapping const& mapping, ProgressCallback progressCallback,
+                       FileChangeCallback fileChangeCallback,
+                       ErrorCallback errorCallback) = 0;
+
+  /**
+   * @brief Extract the given entries into the given buffers, without going through the
+   *   filesystem.
+   *
+   * The output file paths of the entries are ignored. Directories are skipped.
+   *
+   * @param entries Entries to extract, from the file list of this archive.
+   * @param buffers Buffers to extract the entries to, buffers[i] receives the content
+   *   of entries[i] and must hold at least entries[i]->getSize() bytes.
+   * @param errorCallback Function called when an error occurs.
+   *
+   * @return true if all the entries were extracted, false otherwise.
+   */
+  virtual bool extractToMemory(std::span<FileData* const> entries,
+                               std::span<const std::span<std::byte>> buffers,
+                               ErrorCallback errorCallback) = 0;
+
+  /**
+   * @brief Extract the given entries into buffers allocated by the library, without
+   *   going through the filesystem.
+   *
+   * The output file paths of the entries are ignored. Directories are skipped.
+   *
+   * @param entries Entries to extract, from the file list of this archive.
+   * @param buffers Replaced by the extracted content, buffers[i] receives the content
+   *   of entries[i].
+   * @param errorCallback Function called when an error occurs.
+   *
+   * @return true if all the entries were extracted, false otherwise.
+   */
+  virtual bool extractToMemory(std::span<FileData* const> entries,
+                               std::vector<std::vector<std::byte>>& buffers,
+                               ErrorCallback errorCallback) = 0;
+
+  /**
+   * @brief Open a stream reading the content of the given entry.
+   *
+   * The stream decodes from the reader of the archive until the end of the entry has
+   * been read or the stream has been destroyed; until then, opening another entry and
+   * extracting fail with ERROR_LIBRARY_ERROR rather than decode at the same time.
+   * Destroying the stream before the end of the entry stops the decoding.
+   *
+   * 7z cannot list and decode at once, so the properties of entries that were never
+   * read must not be read from another thread until then either; only the entries
+   * near the opened one are loaded when it is opened.
+   *
+   * @param entry Entry to read, from the file list of this archive.
+   *
+   * @return the stream, or a null pointer if the entry cannot be read (e.g. it is a
+   *   directory).
+   */
+  virtual std::unique_ptr<EntryStream> openEntry(FileData* entry) = 0;
+
+  /**
+   * @brief Decode the given entries in a single pass, yielding their content as it is
+   *   decoded.
+   *
+   * Decoding runs on a background thread that waits while a chunk is being processed,
+   * so chunks point directly to the data decoded by 7z. The chunks of an entry are
+   * yielded in order, but entries are yielded in archive order, not in the given
+   * order. Directories and empty files yield a single empty chunk.
+   *
+   * The sequence ends early if an error occurs or the extraction is cancelled, in which
+   * case getLastError() is set when the iteration ends. The archive must not be used
+   * for anything else until the generator has been destroyed.
+   *
+   * @param entries Entries to decode, from the file list of this archive, which must
+   *   remain valid until the generator has been destroyed.
+   * @param errorCallback Function called when an error occurs.
+   *
+   * @return the sequence of chunks.
+   */
+  virtual Generator<EntryChunk> chunks(std::span<FileData* const> entries,
+                                       ErrorCallback errorCallback) = 0;
+
   /**
    * @brief Cancel the current extraction process.
    */
   virtual void cancel() = 0;
 
+  /**
+   * @brief Set the limits applied to the next extractions.
+   *
+   * @param limits The new limits, default-constructed limits to remove them.
+   */
+  virtual void setExtractionLimits(ExtractionLimits const& limits) = 0;
+
+  /**
+   * @return the limits applied to extractions.
+   */
+  virtual ExtractionLimits getExtractionLimits() const = 0;
+
+  /**
+   * @return statistics about the reads of the opened archive, only filled for archives
+   *   opened with InputMode::PREFETCHED.
+   */
+  virtual InputStats getInputStats() const = 0;
+
   // A bunch of useful overloads (with one or two callbacks):
+  Generator<EntryChunk> chunks(ErrorCallback errorCallback)
+  {
+    return chunks(getFileList(), errorCallback);
+  }
   bool extract(std::filesystem::path const& outputDirectory,
                ErrorCallback errorCallback)
   {
@@ -275,6 +1069,91 @@ public:
   }
 };
 
+/**
+ * @brief Pool of archives reused from one archive file to the next, see
+ *   CreateArchivePool().
+ *
+ * Each archive created by CreateArchive() loads the 7z library, unless another archive
+ * still holds it, and allocates its own storage for the entries and read buffer.
+ * Archives handed out by a pool keep them from one archive file to the next, although
+ * 7z still creates a reader and its handler for every file opened. A pool can be used
+ * from several threads.
+ */
+class ArchivePool
+{
+public:
+  // archive given back to the pool when destroyed
+  using Handle = std::unique_ptr<Archive, std::function<void(Archive*)>>;
+
+  /**
+   * @brief Take an archive from the pool, or create one if the pool is empty.
+   *
+   * When the handle is destroyed, the archive is closed, its log callback, executor
+   * and extraction limits are reset, and it is given back to the pool, or destroyed if
+   * the pool is full or gone.
+   *
+   * @return the archive, which must be checked with isValid() like the ones created by
+   *   CreateArchive().
+   */
+  virtual Handle acquire() = 0;
+
+  /**
+   * @return the number of archives waiting in the pool.
+   */
+  virtual std::size_t idleCount() const = 0;
+
+  virtual ~ArchivePool() = default;
+};
+
+/**
+ * Listing of an archive file made by ListArchives(), without the archive itself.
+ */
+struct ArchiveListing
+{
+  struct Entry
+  {
+    uint64_t size;
+    uint32_t crc;
+
+    // position of the path of the entry in ArchiveListing::paths
+    uint32_t pathOffset;
+    uint32_t pathSize;
+
+    bool isDirectory;
+  };
+
+  std::filesystem::path archivePath;
+
+  // error of the archive if it could not be listed, in which case it has no entries
+  Archive::Error error = Archive::Error::ERROR_NONE;
+  native_string errorMessage;
+
+  std::vector<Entry> entries;
+
+  // paths of the entries, back to back
+  native_string paths;
+
+  [[nodiscard]] native_string_view path(Entry const& entry) const
+  {
+    return native_string_view(paths).substr(entry.pathOffset, entry.pathSize);
+  }
+};
+
+/**
+ * Options of ListArchives().
+ */
+struct ListArchivesOptions
+{
+  // options used to open each archive file, archives with encrypted headers cannot be
+  // listed since no password is asked for
+  Archive::OpenOptions openOptions;
+
+  // executor running the listing, or a null pointer to use the built-in pool; as many
+  // archives are listed at once as the executor runs tasks concurrently, plus one on
+  // the calling thread
+  std::shared_ptr<Executor> executor;
+};
+
 /**
  * @brief Factory function for archive-objects.
  *
@@ -282,4 +1161,111 @@ public:
  */
 DLLEXPORT std::unique_ptr<Archive> CreateArchive();
 
+/**
+ * @brief Factory function for archive-objects using the given executor.
+ *
+ * @param executor The executor used to schedule the internal tasks of the archive, or
+ *   a null pointer to use the built-in pool.
+ *
+ * @return a pointer to a new Archive object that can be used to manipulate archives.
+ */
+DLLEXPORT std::unique_ptr<Archive> CreateArchive(std::shared_ptr<Executor> executor);
+
+/**
+ * @brief Create a pool of archives.
+ *
+ * @param maxIdle Maximum number of archives kept in the pool, 0 to keep one per
+ *   hardware thread.
+ * @param executor The executor given to the archives of the pool, or a null pointer to
+ *   use the built-in pool.
+ *
+ * @return a pointer to the new pool.
+ */
+DLLEXPORT std::shared_ptr<ArchivePool>
+CreateArchivePool(std::size_t maxIdle                = 0,
+                  std::shared_ptr<Executor> executor = nullptr);
+
+/**
+ * @brief List many archive files at once, reading their headers in parallel.
+ *
+ * The archives are listed by a pool of archives sharing the 7z library, on tasks of the
+ * executor and on the calling thread, which lists archives while it waits for the
+ * others and therefore never depends on a free thread of the executor. An archive that
+ * cannot be listed, whatever the reason, does not stop the others, its listing holds
+ * the error instead.
+ *
+ * @param archivePaths Paths of the archive files.
+ * @param callback Called with the index of each archive in archivePaths and its
+ *   listing, from the calling thread, in the order the listings are completed.
+ * @param options Options of the listing.
+ */
+DLLEXPORT void
+ListArchives(std::span<const std::filesystem::path> archivePaths,
+             std::function<void(std::size_t, ArchiveListing&&)> const& callback,
+             ListArchivesOptions const& options = {});
+
+/**
+ * @brief List many archive files at once, see the overload above.
+ *
+ * @return the listings of the archives, in the order of archivePaths.
+ */
+DLLEXPORT std::vector<ArchiveListing>
+ListArchives(std::span<const std::filesystem::path> archivePaths,
+             ListArchivesOptions const& options = {});
+
+/**
+ * @brief Create a thread pool that can be used as an executor for archives.
+ *
+ * @param threadCount Number of worker threads, 0 to use one thread per hardware thread.
+ *
+ * @return a pointer to the new executor.
+ */
+DLLEXPORT std::shared_ptr<Executor>
+CreateThreadPoolExecutor(std::size_t threadCount = 0);
+
+/**
+ * @brief Create a sink writing each entry to its output file paths, like
+ *   Archive::extract() does.
+ *
+ * @param outputDirectory Directory the output file paths are relative to.
+ *
+ * @return a pointer to the new sink.
+ */
+DLLEXPORT std::shared_ptr<OutputSink>
+CreateDiskSink(std::filesystem::path const& outputDirectory);
+
+/**
+ * @return a pointer to a new sink keeping the extracted content in memory.
+ */
+DLLEXPORT std::shared_ptr<MemorySink> CreateMemorySink();
+
+/**
+ * @return a pointer to a new sink computing the size and CRC32 of the extracted
+ *   content.
+ */
+DLLEXPORT std::shared_ptr<HashSink> CreateHashSink();
+
+/**
+ * @brief Create a sink forwarding the extracted content to all the given sinks.
+ *
+ * @param sinks The sinks to forward to, in order.
+ *
+ * @return a pointer to the new sink.
+ */
+DLLEXPORT std::shared_ptr<OutputSink>
+CreateTeeSink(std::vector<std::shared_ptr<OutputSink>> sinks);
+
+/**
+ * @brief Compile the given rules into a matcher.
+ *
+ * @param rules The rules, in order of priority.
+ * @param match How to compare the literal parts of patterns with paths.
+ * @param error Set to the reason of the failure if a rule is invalid.
+ *
+ * @return a pointer to the compiled rules, or a null pointer if a rule is invalid.
+ */
+DLLEXPORT std::shared_ptr<const PathRules>
+CompilePathRules(std::span<const PathRule> rules, Archive::PathMatch match,
+                 native_string& error);
+
 #endif  // ARCHIVE_H
@@ -0,0 +1,152 @@
+/*
+Mod Organizer archive handling
+
+Copyright (C) 2012 Sebastian Herbord, 2020 MO2 Team. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ARCHIVE_GENERATOR_H
+#define ARCHIVE_GENERATOR_H
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+/**
+ * @brief Sequence of values produced lazily by a coroutine, which can be iterated
+ *   once.
+ *
+ * This is a minimal equivalent of the C++23 std::generator: values are yielded by
+ * reference, so they are only valid until the iterator is incremented. Exceptions
+ * thrown by the coroutine are rethrown by begin() or by the increment operator.
+ */
+template <typename T>
+class Generator
+{
+public:
+  struct promise_type
+  {
+    const T* value = nullptr;
+    std::exception_ptr exception;
+
+    Generator get_return_object()
+    {
+      return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+
+    std::suspend_always yield_value(T const& yielded) noexcept
+    {
+      value = std::addressof(yielded);
+      return {};
+    }
+
+    void return_void() noexcept {}
+    void unhandled_exception() { exception = std::current_exception(); }
+  };
+
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  class iterator
+  {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type        = T;
+    using difference_type   = std::ptrdiff_t;
+
+    iterator() = default;
+    explicit iterator(handle_type handle) : m_Handle(handle) {}
+
+    T const& operator*() const { return *m_Handle.promise().value; }
+    T const* operator->() const { return m_Handle.promise().value; }
+
+    iterator& operator++()
+    {
+      resume(m_Handle);
+      return *this;
+    }
+
+    void operator++(int) { ++*this; }
+
+    friend bool operator==(iterator const& it, std::default_sentinel_t) noexcept
+    {
+      return !it.m_Handle || it.m_Handle.done();
+    }
+
+  private:
+    handle_type m_Handle;
+  };
+
+  Generator(Generator&& other) noexcept
+      : m_Handle(std::exchange(other.m_Handle, nullptr))
+  {}
+
+  Generator& operator=(Generator&& other) noexcept
+  {
+    if (this != &other) {
+      if (m_Handle) {
+        m_Handle.destroy();
+      }
+      m_Handle = std::exchange(other.m_Handle, nullptr);
+    }
+    return *this;
+  }
+
+  Generator(const Generator&)            = delete;
+  Generator& operator=(const Generator&) = delete;
+
+  // destroying the generator before the end stops the coroutine at its current
+  // co_yield, running the destructors of its locals
+  ~Generator()
+  {
+    if (m_Handle) {
+      m_Handle.destroy();
+    }
+  }
+
+  /**
+   * @brief Run the coroutine up to its first value.
+   */
+  iterator begin()
+  {
+    if (m_Handle) {
+      resume(m_Handle);
+    }
+    return iterator(m_Handle);
+  }
+
+  std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+  explicit Generator(handle_type handle) : m_Handle(handle) {}
+
+  static void resume(handle_type handle)
+  {
+    handle.resume();
+    if (handle.promise().exception) {
+      std::rethrow_exception(std::exchange(handle.promise().exception, nullptr));
+    }
+  }
+
+  handle_type m_Handle;
+};
+
+#endif  // ARCHIVE_GENERATOR_H
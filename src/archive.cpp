@@ -1,13 +1,41 @@
 #include "archive.h"
+#include "archivetree.h"
+#include "entrystream.h"
+#include "entrytable.h"
+#include "formatdetector.h"
+#include "inputstreams.h"
+#include "mappedfile.h"
+#include "listingcache.h"
+#include "outputsinks.h"
+#include "pathindex.h"
+#include "prefetch.h"
+#include "priority.h"
+#include "rendezvous.h"
+#include "tarball.h"
+#include "threadpool.h"
+#include "tokenbucket.h"
+#include "volumes.h"
+#include "writebehindqueue.h"
 
 #include <bit7z/bit7zlibraryloader.hpp>
 #include <bit7z/bitabstractarchivehandler.hpp>
 #include <bit7z/bitarchivereader.hpp>
+#include <bit7z/biterror.hpp>
 #include <bit7z/bitformat.hpp>
 
+#include <algorithm>
 #include <atomic>
 #include <filesystem>
 #include <fstream>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -42,24 +70,134 @@ tstring getLibraryPath()
   return to_tstring(L"dlls/7zip.dll");
 #endif
 }
+
+// the 7z library shared by all the archives, unloaded once no archive uses it
+shared_ptr<const Bit7zLibraryLoader> sharedLibrary(error_code& ec)
+{
+  static mutex instanceMutex;
+  static weak_ptr<const Bit7zLibraryLoader> instance;
+
+  scoped_lock lock(instanceMutex);
+  auto library = instance.lock();
+  if (!library) {
+    auto loaded = make_shared<Bit7zLibraryLoader>();
+    loaded->load(getLibraryPath(), ec);
+    if (ec) {
+      return nullptr;
+    }
+    library  = std::move(loaded);
+    instance = library;
+  }
+  return library;
+}
+
+// decoding thread of chunks(), stopped when the generator is destroyed
+struct ChunkProducer
+{
+  ~ChunkProducer() { rendezvous.close(); }
+
+  Rendezvous<Archive::EntryChunk> rendezvous;
+
+  // must be the last member so the thread is joined before the rendezvous is destroyed
+  jthread thread;
+};
+
+// move back to the start of the stream, clearing errors of previous reads
+void rewind(istream& stream)
+{
+  stream.clear();
+  stream.seekg(0);
+}
+
+// read the start of the archive, for format detection, then rewind the stream
+span<const std::byte> readHeader(istream& stream,
+                                 span<char, FormatDetector::HEADER_SIZE> header)
+{
+  rewind(stream);
+  stream.read(header.data(), header.size());
+  const auto size = static_cast<size_t>(stream.gcount());
+  rewind(stream);
+
+  return as_bytes(header.first(size));
+}
+
+// 7z reader together with the stream it reads from, which must outlive it
+struct StreamArchiveReader
+{
+  StreamArchiveReader(unique_ptr<streambuf> buffer, shared_ptr<MappedFile> mapping)
+      : mapping(std::move(mapping)), buffer(std::move(buffer)),
+        stream(this->buffer.get())
+  {}
+
+  // read another archive from the given buffer, or release the input if it is null
+  void reset(unique_ptr<streambuf> newBuffer, shared_ptr<MappedFile> newMapping)
+  {
+    reader.reset();
+    volumesPath.clear();
+    mapping = std::move(newMapping);
+    buffer  = std::move(newBuffer);
+    stream.rdbuf(buffer.get());
+  }
+
+  // create the reader, from the stream unless volumesPath is set
+  void open(shared_ptr<const Bit7zLibraryLoader> library, BitInFormat const& format,
+            tstring const& password = {})
+  {
+    reader.reset();
+    this->library = std::move(library);
+    if (volumesPath.empty()) {
+      reader.emplace(*this->library, stream, format, password);
+    } else {
+      reader.emplace(*this->library, to_tstring(volumesPath.native()), format,
+                     password);
+    }
+  }
+
+  // the reader uses the library, which must outlive it
+  shared_ptr<const Bit7zLibraryLoader> library;
+
+  // mapping the buffer reads from, if any
+  shared_ptr<MappedFile> mapping;
+
+  // first of a set of volumes that 7z must read by itself, the stream is then only
+  // used to detect the format
+  fs::path volumesPath;
+
+  unique_ptr<streambuf> buffer;
+  istream stream;
+  optional<BitArchiveReader> reader;
+
+  // set while an entry stream decodes from the reader on its own thread
+  atomic<bool> streaming = false;
+};
+
 }  // namespace
 
-class FileDataImpl : public FileData
+class FileDataImpl final : public FileData
 {
   friend class Archive;
 
 public:
-  FileDataImpl(std::filesystem::path fileName, uint64_t size, uint64_t crc,
-               bool isDirectory)
-      : m_FileName(std::move(fileName)), m_Size(size), m_CRC(crc),
-        m_IsDirectory(isDirectory)
+  FileDataImpl(uint32_t index, EntryTable const& table)
+      : m_Index(index), m_Table(&table)
   {}
 
+  // index of this entry in the archive
+  [[nodiscard]] uint32_t index() const { return m_Index; }
+
   [[nodiscard]] std::filesystem::path getArchiveFilePath() const override
   {
-    return m_FileName;
+    return getArchiveFilePathView();
+  }
+  [[nodiscard]] native_string_view getArchiveFilePathView() const override
+  {
+    return m_Table->path(m_Index);
+  }
+  [[nodiscard]] native_string_view getPathKey() const override
+  {
+    return m_Table->key(m_Index);
   }
-  [[nodiscard]] uint64_t getSize() const override { return m_Size; }
+  [[nodiscard]] uint64_t getSize() const override { return m_Table->size(m_Index); }
 
   void addOutputFilePath(std::filesystem::path const& fileName) override
   {
@@ -74,15 +212,41 @@ public:
   void clearOutputFilePaths() override { m_OutputFilePaths.clear(); }
 
   [[nodiscard]] bool isEmpty() const { return m_OutputFilePaths.empty(); }
-  [[nodiscard]] bool isDirectory() const override { return m_IsDirectory; }
-  [[nodiscard]] uint64_t getCRC() const override { return m_CRC; }
+  [[nodiscard]] bool isDirectory() const override
+  {
+    return m_Table->isDirectory(m_Index);
+  }
+  [[nodiscard]] uint64_t getCRC() const override { return m_Table->crc(m_Index); }
+  [[nodiscard]] uint64_t getPackedSize() const override
+  {
+    return m_Table->packedSize(m_Index);
+  }
+  [[nodiscard]] std::chrono::system_clock::time_point
+  getModificationTime() const override
+  {
+    return m_Table->modified(m_Index);
+  }
+  [[nodiscard]] uint32_t getAttributes() const override
+  {
+    return m_Table->attributes(m_Index);
+  }
+  [[nodiscard]] native_string_view getCompressionMethod() const override
+  {
+    return m_Table->method(m_Index);
+  }
+  [[nodiscard]] bool isEncrypted() const override
+  {
+    return m_Table->isEncrypted(m_Index);
+  }
+  [[nodiscard]] uint32_t getBlockIndex() const override
+  {
+    return m_Table->block(m_Index);
+  }
 
 private:
-  std::filesystem::path m_FileName;
-  uint64_t m_Size;
-  uint64_t m_CRC;
+  uint32_t m_Index;
+  const EntryTable* m_Table;
   std::vector<std::filesystem::path> m_OutputFilePaths;
-  bool m_IsDirectory;
 };
 
 /// represents the connection to one archive and provides common functionality
@@ -94,7 +258,7 @@ class ArchiveImpl : public Archive
   static LogCallback DefaultLogCallback;
 
 public:
-  ArchiveImpl();
+  explicit ArchiveImpl(std::shared_ptr<Executor> executor);
   ~ArchiveImpl() override;
 
   [[nodiscard]] bool isValid() const override { return m_Valid; }
@@ -105,23 +269,168 @@ public:
     // Wrap the callback so that we do not have to check if it is set everywhere:
     m_LogCallback = logCallback ? logCallback : DefaultLogCallback;
   }
+  void setExecutor(std::shared_ptr<Executor> executor) override
+  {
+    m_Executor = executor ? std::move(executor) : defaultExecutor();
+  }
+  [[nodiscard]] std::shared_ptr<Executor> getExecutor() const override
+  {
+    return m_Executor;
+  }
 
   bool open(std::filesystem::path const& archiveName,
             PasswordCallback passwordCallback) override;
+  bool open(std::filesystem::path const& archiveName,
+            PasswordCallback passwordCallback, OpenOptions const& options) override;
+  bool open(std::span<const std::byte> data,
+            PasswordCallback passwordCallback) override;
+  bool open(std::shared_ptr<InputStream> stream,
+            PasswordCallback passwordCallback) override;
   void close() override;
   [[nodiscard]] const std::vector<FileData*>& getFileList() const override
   {
     return m_FileList;
   }
+
+  FileData* findEntry(std::filesystem::path const& path, PathMatch match) override;
+  std::vector<FileData*> listPrefix(std::filesystem::path const& directory,
+                                    PathMatch match) override;
+
+  ArchiveTree const& getTree() override;
+  std::vector<std::vector<FileData*>> getCaseCollisions() override;
+  OutputMapping mapEntries(PathRules const& rules) override;
+  std::vector<FileData*> selectEntries(PathRules const& rules) override;
   bool extract(std::filesystem::path const& outputDirectory,
                ProgressCallback progressCallback, FileChangeCallback fileChangeCallback,
                ErrorCallback errorCallback) override;
+  bool extract(std::span<FileData* const> entries, OutputSink& sink,
+               ProgressCallback progressCallback, FileChangeCallback fileChangeCallback,
+               ErrorCallback errorCallback) override;
+  bool extract(std::filesystem::path const& outputDirectory,
+               OutputMapping const& mapping, ProgressCallback progressCallback,
+               FileChangeCallback fileChangeCallback,
+               ErrorCallback errorCallback) override;
+
+  bool extractToMemory(std::span<FileData* const> entries,
+                       std::span<const std::span<std::byte>> buffers,
+                       ErrorCallback errorCallback) override;
+  bool extractToMemory(std::span<FileData* const> entries,
+                       std::vector<std::vector<std::byte>>& buffers,
+                       ErrorCallback errorCallback) override;
+
+  std::unique_ptr<EntryStream> openEntry(FileData* entry) override;
+
+  Generator<EntryChunk> chunks(std::span<FileData* const> entries,
+                               ErrorCallback errorCallback) override;
 
   void cancel() override;
 
+  void setExtractionLimits(ExtractionLimits const& limits) override
+  {
+    m_ExtractionLimits = limits;
+  }
+  [[nodiscard]] ExtractionLimits getExtractionLimits() const override
+  {
+    return m_ExtractionLimits;
+  }
+
+  [[nodiscard]] InputStats getInputStats() const override
+  {
+    InputStats stats;
+    if (m_PrefetchCounters) {
+      stats.prefetchHits   = m_PrefetchCounters->hits;
+      stats.prefetchMisses = m_PrefetchCounters->misses;
+    }
+    return stats;
+  }
+
 private:
+  // calls made to an output sink by the writer stage
+  enum class SinkCall
+  {
+    BEGIN,
+    WRITE,
+    END
+  };
+
+  // destination of an entry extracted to memory, either a fixed buffer or a vector
+  // owned by the caller
+  struct MemoryTarget
+  {
+    std::span<std::byte> buffer;
+    std::vector<std::byte>* owned = nullptr;
+    std::size_t written           = 0;
+  };
+
   void clearFileList();
   void resetFileList();
+
+  // drop the reader, keeping its read buffer for the next archive if possible
+  void releaseReader();
+
+  // buffered reads from the given stream, through the buffer of the last archive
+  unique_ptr<InputStreamBuf> makeInputBuffer(shared_ptr<InputStream> stream);
+
+  /** @returns true if the library was loaded, reports the error otherwise */
+  [[nodiscard]] bool checkValid();
+
+  // run the given open, reporting the archives that the entries cannot be stored for
+  // (paths too long for a PathTable, not enough memory) rather than throwing
+  template <typename Open>
+  bool openGuarded(Open&& open);
+
+  // the name of the archive, if any, hints at its format and is the key of the
+  // cached format; with readVolumes, 7z reads the volumes starting with that file by
+  // itself and the buffer is only used to detect the format
+  bool openStream(unique_ptr<streambuf> buffer, PasswordCallback passwordCallback,
+                  std::filesystem::path const& archiveName = {},
+                  shared_ptr<MappedFile> mapping           = nullptr,
+                  bool readVolumes                         = false);
+
+  // open the first of a set of volumes
+  bool openVolumes(VolumeSet const& volumes, PasswordCallback passwordCallback);
+
+  // decode the given entries, sorted, calling onFile with the path of each entry
+  // before its data; the entries of a tarball are cut out of its decoded stream
+  void decode(std::span<const uint32_t> indices,
+              TarballReader::FileCallback const& onFile,
+              TarballReader::DataCallback const& onData) const;
+
+  // get ready for decoding the given entries rather than listing: 7z cannot be
+  // queried for entry properties while it extracts, so the batches of the entries are
+  // loaded beforehand, and the input can be tuned
+  void prepareInputForExtraction(std::span<const uint32_t> indices) const;
+
+  bool openFile(std::filesystem::path const& archiveName,
+                PasswordCallback passwordCallback, OpenOptions const& options);
+
+  // open through the listing cache, see OpenOptions::listingCacheDirectory
+  bool openCached(std::filesystem::path const& archiveName,
+                  PasswordCallback passwordCallback, OpenOptions const& options);
+
+  // open the reader of an archive listed from the cache if not done yet
+  bool ensureReader();
+
+  // check that no entry stream is decoding from the reader, which cannot decode
+  // anything else at the same time
+  bool checkNotStreaming();
+
+  // create the entries of the file list once m_Table is set
+  void createEntries();
+
+  // finish opening the archive once the reader has been created
+  void initReader(PasswordCallback passwordCallback);
+
+  // index the paths of the entries if not done yet
+  PathIndex const& pathIndex();
+
+  /** @returns the given entry if it belongs to the file list, nullptr otherwise */
+  [[nodiscard]] FileDataImpl* toFileDataImpl(FileData* fileData);
+
+  bool createOutputDirectory(std::filesystem::path const& outputDirectory);
+
+  bool extractToTargets(std::span<FileData* const> entries,
+                        std::vector<MemoryTarget>& targets);
   void reportError(const tstring& message) const;
 
   // callback wrapper functions
@@ -133,8 +442,29 @@ private:
   Error m_LastError;
   std::atomic<bool> m_shouldCancel = false;
 
-  Bit7zLibraryLoader m_Library;
-  unique_ptr<BitArchiveReader> m_ArchivePtr;
+  // shared by the archives, see sharedLibrary()
+  shared_ptr<const Bit7zLibraryLoader> m_Library;
+  // shared with the entry streams, which may outlive an open archive
+  shared_ptr<BitArchiveReader> m_ArchivePtr;
+
+  // holder of m_ArchivePtr, owned through it
+  StreamArchiveReader* m_Reader = nullptr;
+
+  // holder of the last archive, without its input, reused by the next one unless an
+  // entry stream kept it
+  shared_ptr<StreamArchiveReader> m_SpareReader;
+
+  // entries of a compressed tarball read by m_ArchivePtr, listed from its tar headers
+  shared_ptr<TarballReader> m_Tarball;
+
+  // buffer of the last archive read with buffered reads, reused by the next one
+  std::vector<char> m_ReadBuffer;
+
+  // mapping of the archive file when opened with InputMode::MEMORY_MAPPED
+  shared_ptr<MappedFile> m_MappedFile;
+
+  // counters of the read-ahead when opened with InputMode::PREFETCHED
+  shared_ptr<PrefetchCounters> m_PrefetchCounters;
 
   ProgressType m_ProgressType;
   uint64_t m_Total;
@@ -146,25 +476,54 @@ private:
   ErrorCallback m_ErrorCallback;
   PasswordCallback m_PasswordCallback;
 
+  std::shared_ptr<Executor> m_Executor;
+  ExtractionLimits m_ExtractionLimits;
+
+  // entries of the archive in a single allocation, never reallocated while the archive
+  // is open since m_FileList points into it
+  std::vector<FileDataImpl> m_Entries;
   std::vector<FileData*> m_FileList;
 
+  // properties of m_Entries
+  EntryTable m_Table;
+
+  // built on the first lookup
+  PathIndex m_PathIndex;
+
+  // built on the first call to getTree()
+  std::optional<ArchiveTree> m_Tree;
+
+  // how to open the reader of an archive listed from the cache
+  struct DeferredOpen
+  {
+    std::filesystem::path archiveName;
+    PasswordCallback passwordCallback;
+    OpenOptions options;
+  };
+  std::optional<DeferredOpen> m_DeferredOpen;
+
   native_string m_Password;
+
+  // format of the last archive file opened, reused when it is opened again
+  std::filesystem::path m_FormatArchiveName;
+  const BitInFormat* m_Format = nullptr;
 };
 
 Archive::LogCallback ArchiveImpl::DefaultLogCallback([](LogLevel,
                                                         native_string const&) {});
 
-ArchiveImpl::ArchiveImpl()
+ArchiveImpl::ArchiveImpl(std::shared_ptr<Executor> executor)
     : m_Valid(false), m_LastError(Error::ERROR_NONE), m_ArchivePtr(nullptr),
       m_ProgressType(ProgressType::EXTRACTION), m_Total(0),
       m_FileChangeType(FileChangeType::EXTRACTION_START)
 {
-  // Reset the log callback:
+  // Reset the log callback and executor:
   ArchiveImpl::setLogCallback({});
+  ArchiveImpl::setExecutor(std::move(executor));
 
   error_code ec;
-  m_Library.load(getLibraryPath(), ec);
-  if (ec) {
+  m_Library = sharedLibrary(ec);
+  if (!m_Library) {
     reportError(format(BIT7Z_STRING("Could not find 7z library: {}"),
                        to_tstring(ec.message())));
     m_LastError = Error::ERROR_LIBRARY_NOT_FOUND;
@@ -178,8 +537,7 @@ ArchiveImpl::~ArchiveImpl()
   ArchiveImpl::close();
 }
 
-bool ArchiveImpl::open(std::filesystem::path const& archiveName,
-                       PasswordCallback passwordCallback)
+bool ArchiveImpl::checkValid()
 {
   if (!m_Valid) {
     if (m_LastError == Error::ERROR_LIBRARY_NOT_FOUND) {
@@ -190,6 +548,63 @@ bool ArchiveImpl::open(std::filesystem::path const& archiveName,
     }
     return false;
   }
+  return true;
+}
+
+bool ArchiveImpl::open(std::filesystem::path const& archiveName,
+                       PasswordCallback passwordCallback)
+{
+  return open(archiveName, passwordCallback, OpenOptions());
+}
+
+bool ArchiveImpl::open(std::filesystem::path const& archiveName,
+                       PasswordCallback passwordCallback, OpenOptions const& options)
+{
+  // the storage of the previous archive is reused by the next one
+  close();
+
+  return openGuarded([&] {
+    const bool opened = options.listingCacheDirectory.empty()
+                            ? openFile(archiveName, passwordCallback, options)
+                            : openCached(archiveName, passwordCallback, options);
+    if (!opened) {
+      return false;
+    }
+
+    if (options.indexPaths) {
+      pathIndex();
+    }
+    if (options.buildTree) {
+      getTree();
+    }
+    return true;
+  });
+}
+
+template <typename Open>
+bool ArchiveImpl::openGuarded(Open&& open)
+{
+  try {
+    return open();
+  } catch (const std::length_error& ex) {
+    close();
+    m_LastError = Error::ERROR_ARCHIVE_INVALID;
+    reportError(ex.what());
+  } catch (const std::bad_alloc&) {
+    close();
+    m_LastError = Error::ERROR_OUT_OF_MEMORY;
+    reportError(BIT7Z_STRING("Not enough memory to list the archive"));
+  }
+  return false;
+}
+
+bool ArchiveImpl::openFile(std::filesystem::path const& archiveName,
+                           PasswordCallback passwordCallback,
+                           OpenOptions const& options)
+{
+  if (!checkValid()) {
+    return false;
+  }
 
   // If it doesn't exist or is a directory, error
   if (!exists(archiveName) || is_directory(archiveName)) {
@@ -199,209 +614,1108 @@ bool ArchiveImpl::open(std::filesystem::path const& archiveName,
     return false;
   }
 
-  try {
-    if (BitArchiveReader::isHeaderEncrypted(m_Library, to_tstring(archiveName.native()),
-                                            BitFormat::Auto)) {
-      m_Password = passwordCallback();
+  // volumes are always read with buffered reads
+  if (const auto volumes = VolumeSet::find(archiveName);
+      volumes.kind != VolumeSet::Kind::NONE) {
+    return openVolumes(volumes, passwordCallback);
+  }
+
+  if (options.inputMode == InputMode::MEMORY_MAPPED) {
+    error_code ec;
+    auto mapping = MappedFile::open(archiveName, ec);
+    if (!mapping) {
+      m_LastError = Error::ERROR_FAILED_TO_OPEN_ARCHIVE;
+      reportError(format(BIT7Z_STRING("Could not map archive file {}: {}"),
+                         to_tstring(archiveName.native()), ec.message()));
+      return false;
     }
 
-    m_ArchivePtr =
-        make_unique<BitArchiveReader>(m_Library, to_tstring(archiveName.native()),
-                                      BitFormat::Auto, to_tstring(m_Password));
-    m_PasswordCallback = passwordCallback;
-    m_ArchivePtr->setPasswordCallback([this] {
-      return passwordCallbackWrapper();
-    });
+    // parsing headers jumps around the archive
+    mapping->advise(MappedFile::Access::RANDOM);
 
-    m_LastError = Error::ERROR_NONE;
-    resetFileList();
-    return true;
+    auto buffer = make_unique<SpanStreamBuf>(mapping->data());
+    return openStream(std::move(buffer), passwordCallback, archiveName,
+                      std::move(mapping));
+  }
 
-  } catch (const BitException& ex) {
+  error_code ec;
+  auto file = FileInputStream::open(archiveName, ec);
+  if (!file) {
     m_LastError = Error::ERROR_FAILED_TO_OPEN_ARCHIVE;
-    reportError(ex.what());
+    reportError(format(BIT7Z_STRING("Could not open archive file {}: {}"),
+                       to_tstring(archiveName.native()), ec.message()));
     return false;
   }
-}
 
-void ArchiveImpl::close()
-{
-  m_ArchivePtr.reset();
-  clearFileList();
-  m_PasswordCallback = {};
-  m_shouldCancel.store(false);
-}
+  if (options.inputMode == InputMode::PREFETCHED) {
+    auto counters = make_shared<PrefetchCounters>();
+    auto buffer   = make_unique<PrefetchStreamBuf>(std::move(file), m_Executor,
+                                                 options.prefetchWindowSize, counters);
+    if (!openStream(std::move(buffer), passwordCallback, archiveName)) {
+      return false;
+    }
 
-void ArchiveImpl::clearFileList()
-{
-  for (FileData* iter : m_FileList) {
-    delete dynamic_cast<FileDataImpl*>(iter);
+    m_PrefetchCounters = std::move(counters);
+    return true;
   }
-  m_FileList.clear();
+
+  // the file is opened and its headers parsed once, the password being only asked
+  // for if that fails
+  return openStream(makeInputBuffer(std::move(file)), passwordCallback, archiveName);
 }
 
-void ArchiveImpl::resetFileList()
+bool ArchiveImpl::openVolumes(VolumeSet const& volumes,
+                              PasswordCallback passwordCallback)
 {
-  clearFileList();
+  const auto& archiveName = volumes.paths.front();
 
-  m_FileList.reserve(m_ArchivePtr->itemsCount());
+  error_code ec;
+  if (volumes.kind == VolumeSet::Kind::SPLIT) {
+    // the pieces are read one after another as the stream reaches them
+    auto stream = VolumeInputStream::open(volumes.paths, ec);
+    if (!stream) {
+      m_LastError = Error::ERROR_FAILED_TO_OPEN_ARCHIVE;
+      reportError(format(BIT7Z_STRING("Could not open the volumes of {}: {}"),
+                         to_tstring(archiveName.native()), ec.message()));
+      return false;
+    }
+    return openStream(makeInputBuffer(std::move(stream)), passwordCallback,
+                      archiveName);
+  }
 
-  for (const auto& item : *m_ArchivePtr) {
-    m_FileList.push_back(
-        new FileDataImpl(item.path(), item.size(), item.crc(), item.isDir()));
+  // 7z opens the next RAR volumes when decoding reaches them, but only when reading
+  // the archive from its path; the first volume is only read here for its format
+  auto file = FileInputStream::open(archiveName, ec);
+  if (!file) {
+    m_LastError = Error::ERROR_FAILED_TO_OPEN_ARCHIVE;
+    reportError(format(BIT7Z_STRING("Could not open archive file {}: {}"),
+                       to_tstring(archiveName.native()), ec.message()));
+    return false;
   }
+  return openStream(make_unique<InputStreamBuf>(std::move(file),
+                                                FormatDetector::HEADER_SIZE),
+                    passwordCallback, archiveName, nullptr, true);
 }
 
-bool ArchiveImpl::extract(std::filesystem::path const& outputDirectory,
-                          ProgressCallback progressCallback,
-                          FileChangeCallback fileChangeCallback,
-                          ErrorCallback errorCallback)
-
+bool ArchiveImpl::openCached(std::filesystem::path const& archiveName,
+                             PasswordCallback passwordCallback,
+                             OpenOptions const& options)
 {
-  if (!m_Valid) {
+  if (!checkValid()) {
     return false;
   }
 
-  try {
-    m_ProgressCallback   = progressCallback;
-    m_FileChangeCallback = fileChangeCallback;
-    m_ErrorCallback      = errorCallback;
+  // the key of the listing only covers the first volume
+  if (VolumeSet::find(archiveName).kind != VolumeSet::Kind::NONE) {
+    return openFile(archiveName, passwordCallback, options);
+  }
 
-    // set file callback
-    // currentFile is required to know which file is being extracted in the
-    // RawDataCallback
-    tstring currentFile;
-    if (m_FileChangeCallback) {
-      m_ArchivePtr->setFileCallback([&](const tstring& path) {
-        currentFile = path;
-        m_FileChangeCallback(m_FileChangeType, fs::path(path));
-      });
-    } else {
-      m_ArchivePtr->setFileCallback([&](const tstring& path) {
-        currentFile = path;
-      });
-    }
+  ListingCache::Key key;
+  error_code ec;
+  if (!ListingCache::makeKey(archiveName, key, ec)) {
+    // let the normal open report why the archive cannot be read
+    return openFile(archiveName, passwordCallback, options);
+  }
 
-    // we could test the archive if we wanted to by calling
-    // m_ArchivePtr->test();
+  const auto cacheFile = ListingCache::fileFor(options.listingCacheDirectory, key);
+  if (auto cache = ListingCache::load(cacheFile, key)) {
+    close();
+    m_Table.reset(std::move(cache));
+    createEntries();
 
-    // Retrieve the list of indices we want to extract:
-    vector<uint32_t> indices;
+    m_LogCallback(LogLevel::Debug,
+                  to_native_string(format(BIT7Z_STRING("Listed {} from {}"),
+                                          to_tstring(archiveName.native()),
+                                          to_tstring(cacheFile.native()))));
 
-    m_Total = 0;
+    m_DeferredOpen = DeferredOpen{archiveName, passwordCallback, options};
+    m_LastError    = Error::ERROR_NONE;
+    return true;
+  }
 
-    std::unordered_map<tstring, vector<ofstream>> fileMap;
+  if (!openFile(archiveName, passwordCallback, options)) {
+    return false;
+  }
 
-    error_code ec;
-    create_directories(outputDirectory, ec);
+  // the listing of archives with encrypted headers must not end up on disk
+  if (m_Password.empty()) {
+    ListingCache::save(cacheFile, key, m_FileList, ec);
     if (ec) {
-      m_LastError = Error::ERROR_LIBRARY_ERROR;
-      reportError(format(BIT7Z_STRING("Error creating output directory '{}': {}"),
-                         to_tstring(outputDirectory.native()), ec.message()));
-      return false;
+      m_LogCallback(LogLevel::Warning,
+                    to_native_string(format(
+                        BIT7Z_STRING("Could not save the listing of {} to {}: {}"),
+                        to_tstring(archiveName.native()),
+                        to_tstring(cacheFile.native()), ec.message())));
     }
+  }
 
-    for (size_t i = 0; i < m_FileList.size(); ++i) {
-      auto* fileData = dynamic_cast<FileDataImpl*>(m_FileList[i]);
-
-      vector<ofstream> outputs;
-      const auto& outputFilePaths = fileData->getOutputFilePaths();
-      outputs.reserve(outputFilePaths.size());
-
-      for (const fs::path& outputFilePath : outputFilePaths) {
-        if (fileData->isDirectory()) {
-          fs::create_directories(outputFilePath, ec);
-          if (ec) {
-            m_LastError = Error::ERROR_LIBRARY_ERROR;
-            reportError(format(BIT7Z_STRING("Error creating directory '{}': {}"),
-                               to_tstring(outputFilePath.native()), ec.message()));
-            return false;
-          }
-        } else {
-          // create output directory
-          if (outputFilePath.has_parent_path()) {
-            fs::path parentPath = outputDirectory / outputFilePath.parent_path();
-            fs::create_directories(parentPath, ec);
-            if (ec) {
-              m_LastError = Error::ERROR_LIBRARY_ERROR;
-              reportError(format(BIT7Z_STRING("Error creating directory '{}': {}"),
-                                 to_tstring(parentPath.native()), ec.message()));
-              return false;
-            }
-          }
-          ofstream ofs(outputDirectory / outputFilePath, ios::binary | ios::trunc);
-          try {
-            ofs.exceptions(ios::failbit | ios::badbit);
-          } catch (const ios_base::failure& ex) {
-            reportError(format(BIT7Z_STRING("Error opening '{}' for writing: {}"),
-                               to_tstring((outputDirectory / outputFilePath).native()),
-                               ex.what()));
-            return false;
-          }
-          outputs.emplace_back(std::move(ofs));
-        }
-      }
+  return true;
+}
 
-      bool inserted = fileMap
-                          .emplace(to_tstring(fileData->getArchiveFilePath().native()),
-                                   std::move(outputs))
-                          .second;
-      if (!inserted) {
-        reportError(format(BIT7Z_STRING("Error adding '{}' to file map"),
-                           to_tstring(fileData->getArchiveFilePath().native())));
-        m_LastError = Error::ERROR_LIBRARY_ERROR;
-        return false;
-      }
-      if (!fileData->isEmpty()) {
-        indices.push_back(static_cast<uint32_t>(i));
-        m_Total += fileData->getSize();
-      }
-    }
+bool ArchiveImpl::ensureReader()
+{
+  if (m_ArchivePtr) {
+    return true;
+  }
+  if (!m_DeferredOpen) {
+    return false;
+  }
 
-    if (m_ProgressCallback) {
-      m_ArchivePtr->setProgressCallback([this](const uint64_t current) {
-        return progressCallbackWrapper(current);
-      });
-    }
+  const auto& deferred = *m_DeferredOpen;
+  m_LogCallback(
+      LogLevel::Debug,
+      to_native_string(format(BIT7Z_STRING("Reading {} listed from the cache"),
+                              to_tstring(deferred.archiveName.native()))));
+  if (!openFile(deferred.archiveName, deferred.passwordCallback, deferred.options)) {
+    return false;
+  }
 
-    // extract files
-    m_ArchivePtr->extractTo(
-        [&](const byte_t* data, const std::size_t size) -> bool {
-          try {
-            for (auto& stream : fileMap.at(currentFile)) {
-              stream.write(reinterpret_cast<const char*>(data),
-                           static_cast<streamsize>(size));
-            }
-            return true;
-          } catch (const std::out_of_range&) {
-            reportError(
-                format(BIT7Z_STRING("File {} not found in file map"), currentFile));
-            return false;
-          } catch (const ios_base::failure& ex) {
-            reportError(format(BIT7Z_STRING("Error writing to {}: {}"), currentFile,
-                               ex.what()));
-            return false;
-          }
-        },
-        indices);
+  const uint32_t count = m_Tarball ? m_Tarball->count() : m_ArchivePtr->itemsCount();
+  if (count != m_Table.count()) {
+    releaseReader();
+    m_LastError = Error::ERROR_ARCHIVE_INVALID;
+    reportError(format(BIT7Z_STRING("Archive {} does not match its cached listing"),
+                       to_tstring(m_DeferredOpen->archiveName.native())));
+    return false;
+  }
 
-    for (auto& fileData : m_FileList) {
-      fileData->clearOutputFilePaths();
-    }
+  m_DeferredOpen.reset();
+  return true;
+}
 
-    return true;
-  } catch (const BitException& ex) {
-    if (m_shouldCancel) {
-      m_LastError = Error::ERROR_EXTRACT_CANCELLED;
-    } else {
-      m_LastError = Error::ERROR_LIBRARY_ERROR;
-    }
-    reportError(ex.what());
+bool ArchiveImpl::checkNotStreaming()
+{
+  if (m_Reader->streaming) {
+    m_LastError = Error::ERROR_LIBRARY_ERROR;
+    reportError(BIT7Z_STRING("An entry stream is still reading from the archive"));
     return false;
   }
+  return true;
 }
 
-void ArchiveImpl::cancel()
+bool ArchiveImpl::open(std::span<const std::byte> data,
+                       PasswordCallback passwordCallback)
+{
+  close();
+  return openGuarded([&] {
+    return openStream(make_unique<SpanStreamBuf>(data), passwordCallback);
+  });
+}
+
+bool ArchiveImpl::open(std::shared_ptr<InputStream> stream,
+                       PasswordCallback passwordCallback)
+{
+  close();
+
+  if (!stream) {
+    m_LastError = Error::ERROR_ARCHIVE_NOT_FOUND;
+    reportError(BIT7Z_STRING("No input stream given"));
+    return false;
+  }
+  return openGuarded([&] {
+    return openStream(makeInputBuffer(std::move(stream)), passwordCallback);
+  });
+}
+
+unique_ptr<InputStreamBuf> ArchiveImpl::makeInputBuffer(shared_ptr<InputStream> stream)
+{
+  return make_unique<InputStreamBuf>(std::move(stream),
+                                     InputStreamBuf::DEFAULT_BUFFER_SIZE,
+                                     std::move(m_ReadBuffer));
+}
+
+bool ArchiveImpl::openStream(unique_ptr<streambuf> buffer,
+                             PasswordCallback passwordCallback,
+                             std::filesystem::path const& archiveName,
+                             shared_ptr<MappedFile> mapping, bool readVolumes)
+{
+  if (!checkValid()) {
+    return false;
+  }
+
+  m_MappedFile = mapping;
+  m_PrefetchCounters.reset();
+  m_Password.clear();
+
+  try {
+    shared_ptr<StreamArchiveReader> holder = std::move(m_SpareReader);
+    if (holder) {
+      holder->reset(std::move(buffer), std::move(mapping));
+    } else {
+      holder = make_shared<StreamArchiveReader>(std::move(buffer), std::move(mapping));
+    }
+    if (readVolumes) {
+      holder->volumesPath = archiveName;
+    }
+
+    // BitFormat::Auto makes 7z try its handlers one by one, so the format is
+    // detected beforehand when possible
+    char headerBuffer[FormatDetector::HEADER_SIZE];
+    const auto header = readHeader(holder->stream, headerBuffer);
+    const BitInFormat* cachedFormat =
+        !archiveName.empty() && archiveName == m_FormatArchiveName ? m_Format : nullptr;
+
+    // the cached format is dropped unless it still opens the archive
+    m_Format = nullptr;
+    m_FormatArchiveName.clear();
+
+    bool opened = false;
+    if (cachedFormat != nullptr) {
+      try {
+        holder->open(m_Library, *cachedFormat);
+        opened = true;
+      } catch (const BitException&) {
+        // the file may have been replaced, open it as if nothing had been cached
+        // rather than asking for a password it may not need
+        rewind(holder->stream);
+      }
+    }
+
+    if (!opened) {
+      const BitInFormat& format = FormatDetector::detect(header, archiveName);
+      try {
+        holder->open(m_Library, format);
+      } catch (const BitException& ex) {
+        rewind(holder->stream);
+
+        // archives with encrypted headers cannot be opened without a password;
+        // rather than parsing the headers twice to check for them beforehand, ask
+        // for the password when 7z failed for the lack of one and read the stream
+        // again
+        const bool needsPassword = ex.code() == BitFailureSource::WrongPassword;
+        if (passwordCallback && needsPassword &&
+            FormatDetector::canEncryptHeaders(format)) {
+          m_Password = passwordCallback();
+          if (m_Password.empty()) {
+            throw;
+          }
+          holder->open(m_Library, format, to_tstring(m_Password));
+        } else if (format != BitFormat::Auto) {
+          // the detection may be wrong, let 7z find the format
+          holder->open(m_Library, BitFormat::Auto);
+        } else {
+          throw;
+        }
+      }
+    }
+
+    if (!archiveName.empty()) {
+      m_FormatArchiveName = archiveName;
+      m_Format            = &holder->reader->detectedFormat();
+    }
+
+    // the reader shares the ownership of the stream
+    m_ArchivePtr = shared_ptr<BitArchiveReader>(holder, &*holder->reader);
+    m_Reader     = holder.get();
+
+    // 7z only sees the tar archive inside of a compressed stream as a single item,
+    // its entries are listed from the tar headers instead
+    if (FormatDetector::isCompressedStream(header, archiveName)) {
+      m_Tarball = TarballReader::open(m_ArchivePtr, m_LogCallback);
+    }
+
+    initReader(passwordCallback);
+    return true;
+
+  } catch (const BitException& ex) {
+    m_LastError = Error::ERROR_FAILED_TO_OPEN_ARCHIVE;
+    reportError(ex.what());
+    return false;
+  }
+}
+
+void ArchiveImpl::decode(std::span<const uint32_t> indices,
+                         TarballReader::FileCallback const& onFile,
+                         TarballReader::DataCallback const& onData) const
+{
+  if (m_Tarball) {
+    m_Tarball->extractTo(indices, onFile, onData);
+    return;
+  }
+
+  m_ArchivePtr->setFileCallback(onFile);
+  m_ArchivePtr->extractTo(onData, vector<uint32_t>(indices.begin(), indices.end()));
+}
+
+void ArchiveImpl::prepareInputForExtraction(std::span<const uint32_t> indices) const
+{
+  m_Table.loadEntries(indices);
+
+  // solid archives are decoded from start to end
+  if (m_MappedFile) {
+    m_MappedFile->advise(m_ArchivePtr->isSolid() ? MappedFile::Access::SEQUENTIAL
+                                                 : MappedFile::Access::NORMAL);
+  }
+}
+
+void ArchiveImpl::initReader(PasswordCallback passwordCallback)
+{
+  m_PasswordCallback = passwordCallback;
+  m_ArchivePtr->setPasswordCallback([this] {
+    return passwordCallbackWrapper();
+  });
+
+  m_LastError = Error::ERROR_NONE;
+
+  // archives listed from the cache keep their entries when the reader is opened
+  if (!m_DeferredOpen) {
+    resetFileList();
+  }
+}
+
+void ArchiveImpl::close()
+{
+  m_DeferredOpen.reset();
+
+  // the entry table shares the reader, so it is cleared first
+  clearFileList();
+  releaseReader();
+  m_MappedFile.reset();
+  m_PrefetchCounters.reset();
+  m_PasswordCallback = {};
+  m_Password.clear();
+  m_shouldCancel.store(false);
+}
+
+void ArchiveImpl::releaseReader()
+{
+  m_Tarball.reset();
+
+  // entry streams that are still reading keep the reader and its buffer
+  if (m_Reader != nullptr && m_ArchivePtr.use_count() == 1) {
+    m_Reader->reader.reset();
+    if (auto* buffer = dynamic_cast<InputStreamBuf*>(m_Reader->buffer.get())) {
+      // the small buffers used to detect the format are not worth keeping
+      auto released = buffer->releaseBuffer();
+      if (released.capacity() >= m_ReadBuffer.capacity()) {
+        m_ReadBuffer = std::move(released);
+      }
+    }
+
+    // the file is closed, but the holder is kept for the next archive
+    m_Reader->reset(nullptr, nullptr);
+    m_SpareReader = shared_ptr<StreamArchiveReader>(m_ArchivePtr, m_Reader);
+  }
+
+  m_ArchivePtr.reset();
+  m_Reader = nullptr;
+}
+
+void ArchiveImpl::clearFileList()
+{
+  m_FileList.clear();
+  m_PathIndex.clear();
+  m_Tree.reset();
+  m_Entries.clear();
+  m_Table.clear();
+}
+
+void ArchiveImpl::resetFileList()
+{
+  clearFileList();
+
+  if (m_Tarball) {
+    m_Table.reset(m_Tarball);
+  } else {
+    // the properties of the entries are only read from 7z when first accessed
+    m_Table.reset(m_ArchivePtr);
+  }
+  createEntries();
+}
+
+void ArchiveImpl::createEntries()
+{
+  const uint32_t count = m_Table.count();
+  m_Entries.reserve(count);
+  m_FileList.reserve(count);
+
+  for (uint32_t index = 0; index < count; ++index) {
+    m_Entries.emplace_back(index, m_Table);
+  }
+
+  for (auto& entry : m_Entries) {
+    m_FileList.push_back(&entry);
+  }
+}
+
+PathIndex const& ArchiveImpl::pathIndex()
+{
+  if (!m_PathIndex.isBuilt()) {
+    m_PathIndex.build(m_FileList);
+  }
+  return m_PathIndex;
+}
+
+FileData* ArchiveImpl::findEntry(std::filesystem::path const& path, PathMatch match)
+{
+  return pathIndex().find(path.native(), match == PathMatch::EXACT);
+}
+
+std::vector<FileData*> ArchiveImpl::listPrefix(std::filesystem::path const& directory,
+                                               PathMatch match)
+{
+  return pathIndex().listPrefix(directory.native(), match == PathMatch::EXACT);
+}
+
+ArchiveTree const& ArchiveImpl::getTree()
+{
+  if (!m_Tree) {
+    m_Tree = buildArchiveTree(m_FileList);
+  }
+  return *m_Tree;
+}
+
+std::vector<std::vector<FileData*>> ArchiveImpl::getCaseCollisions()
+{
+  return pathIndex().caseCollisions();
+}
+
+OutputMapping ArchiveImpl::mapEntries(PathRules const& rules)
+{
+  OutputMapping mapping;
+  mapping.reserve(m_FileList.size());
+
+  native_string output;
+  PathRules::Buffers buffers;
+  for (uint32_t i = 0; i < m_FileList.size(); ++i) {
+    if (rules.apply(m_FileList[i]->getArchiveFilePathView(), output, buffers) ==
+            PathRules::Result::MAPPED &&
+        !output.empty()) {
+      mapping.add(i, output);
+    }
+  }
+
+  return mapping;
+}
+
+std::vector<FileData*> ArchiveImpl::selectEntries(PathRules const& rules)
+{
+  vector<FileData*> entries;
+
+  native_string output;
+  PathRules::Buffers buffers;
+  for (FileData* entry : m_FileList) {
+    // same entries as mapEntries(), which has nowhere to extract empty paths to
+    if (rules.apply(entry->getArchiveFilePathView(), output, buffers) ==
+            PathRules::Result::MAPPED &&
+        !output.empty()) {
+      entries.push_back(entry);
+    }
+  }
+
+  return entries;
+}
+
+FileDataImpl* ArchiveImpl::toFileDataImpl(FileData* fileData)
+{
+  // entries of this archive are exactly the ones pointing into m_Entries, which is
+  // cheaper to check than a dynamic_cast
+  if (fileData == nullptr || m_Entries.empty()) {
+    return nullptr;
+  }
+
+  const auto address = reinterpret_cast<uintptr_t>(fileData);
+  const auto begin =
+      reinterpret_cast<uintptr_t>(static_cast<FileData*>(m_Entries.data()));
+  if (address < begin) {
+    return nullptr;
+  }
+
+  const uintptr_t offset = address - begin;
+  if (offset % sizeof(FileDataImpl) != 0 ||
+      offset / sizeof(FileDataImpl) >= m_Entries.size()) {
+    return nullptr;
+  }
+  return &m_Entries[offset / sizeof(FileDataImpl)];
+}
+
+bool ArchiveImpl::extract(std::filesystem::path const& outputDirectory,
+                          ProgressCallback progressCallback,
+                          FileChangeCallback fileChangeCallback,
+                          ErrorCallback errorCallback)
+
+{
+  if (!m_Valid) {
+    return false;
+  }
+
+  m_ErrorCallback = errorCallback;
+
+  if (!createOutputDirectory(outputDirectory)) {
+    return false;
+  }
+
+  // Retrieve the list of entries we want to extract:
+  vector<FileData*> entries;
+  for (auto& fileData : m_Entries) {
+    if (!fileData.isEmpty()) {
+      entries.push_back(&fileData);
+    }
+  }
+
+  auto sink = CreateDiskSink(outputDirectory);
+  if (!extract(entries, *sink, progressCallback, fileChangeCallback, errorCallback)) {
+    return false;
+  }
+
+  for (auto& fileData : m_Entries) {
+    fileData.clearOutputFilePaths();
+  }
+
+  return true;
+}
+
+bool ArchiveImpl::extract(std::filesystem::path const& outputDirectory,
+                          OutputMapping const& mapping,
+                          ProgressCallback progressCallback,
+                          FileChangeCallback fileChangeCallback,
+                          ErrorCallback errorCallback)
+{
+  if (!m_Valid) {
+    return false;
+  }
+
+  m_ErrorCallback = errorCallback;
+
+  // check the whole mapping before creating anything
+  auto plan = make_shared<OutputPlan>();
+  native_string error;
+  if (!plan->build(mapping, static_cast<uint32_t>(m_Entries.size()), error)) {
+    m_LastError = Error::ERROR_INVALID_OUTPUT_MAPPING;
+    reportError(to_tstring(error));
+    return false;
+  }
+
+  if (!createOutputDirectory(outputDirectory)) {
+    return false;
+  }
+
+  vector<FileData*> entries;
+  for (const uint32_t index : plan->entries()) {
+    entries.push_back(&m_Entries[index]);
+  }
+
+  // the entries given to the sink are always ours
+  auto sink = CreatePlannedDiskSink(outputDirectory, plan, [](FileData const& entry) {
+    return static_cast<FileDataImpl const&>(entry).index();
+  });
+  return extract(entries, *sink, progressCallback, fileChangeCallback, errorCallback);
+}
+
+bool ArchiveImpl::createOutputDirectory(std::filesystem::path const& outputDirectory)
+{
+  error_code ec;
+  create_directories(outputDirectory, ec);
+  if (ec) {
+    m_LastError = Error::ERROR_LIBRARY_ERROR;
+    reportError(format(BIT7Z_STRING("Error creating output directory '{}': {}"),
+                       to_tstring(outputDirectory.native()), ec.message()));
+    return false;
+  }
+  return true;
+}
+
+bool ArchiveImpl::extract(std::span<FileData* const> entries, OutputSink& sink,
+                          ProgressCallback progressCallback,
+                          FileChangeCallback fileChangeCallback,
+                          ErrorCallback errorCallback)
+{
+  if (!m_Valid || !ensureReader()) {
+    return false;
+  }
+
+  m_ProgressCallback   = progressCallback;
+  m_FileChangeCallback = fileChangeCallback;
+  m_ErrorCallback      = errorCallback;
+
+  if (!checkNotStreaming()) {
+    return false;
+  }
+
+  // map archive paths to entries since the file callback only gives us the path,
+  // directories are handled separately since 7z does not always report them
+  std::unordered_map<tstring, FileDataImpl*> fileMap;
+  vector<FileDataImpl*> directories;
+  vector<uint32_t> indices;
+
+  m_Total = 0;
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    FileDataImpl* fileData = toFileDataImpl(entries[i]);
+    if (fileData == nullptr) {
+      m_LastError = Error::ERROR_LIBRARY_ERROR;
+      reportError(format(BIT7Z_STRING("Entry {} does not belong to this archive"), i));
+      return false;
+    }
+
+    if (fileData->isDirectory()) {
+      directories.push_back(fileData);
+      continue;
+    }
+
+    const tstring path = to_tstring(fileData->getArchiveFilePath().native());
+    if (!fileMap.emplace(path, fileData).second) {
+      reportError(format(BIT7Z_STRING("Error adding '{}' to file map"), path));
+      m_LastError = Error::ERROR_LIBRARY_ERROR;
+      return false;
+    }
+    indices.push_back(fileData->index());
+    m_Total += fileData->getSize();
+  }
+
+  // 7z expects the indices to be sorted
+  ranges::sort(indices);
+  prepareInputForExtraction(indices);
+
+  optional<TokenBucket> decodeLimit, writeLimit;
+  if (m_ExtractionLimits.decodeBytesPerSecond > 0) {
+    decodeLimit.emplace(m_ExtractionLimits.decodeBytesPerSecond);
+  }
+  if (m_ExtractionLimits.writeBytesPerSecond > 0) {
+    writeLimit.emplace(m_ExtractionLimits.writeBytesPerSecond);
+  }
+  const bool lowPriority = m_ExtractionLimits.lowPriority;
+
+  try {
+    // the sink is called by the executor while 7z keeps decoding, failedEntry is the
+    // entry being written when the sink failed
+    const FileDataImpl* failedEntry = nullptr;
+    WriteBehindQueue<pair<SinkCall, const FileDataImpl*>> writer(
+        m_Executor, [&](auto& call, span<const std::byte> data) {
+          if (writeLimit) {
+            writeLimit->consume(data.size(), m_shouldCancel);
+          }
+          ScopedBackgroundIo backgroundIo(lowPriority);
+
+          bool result = false;
+          switch (call.first) {
+          case SinkCall::BEGIN:
+            result = sink.beginEntry(*call.second);
+            break;
+          case SinkCall::WRITE:
+            result = sink.write(*call.second, data);
+            break;
+          case SinkCall::END:
+            result = sink.endEntry(*call.second);
+            break;
+          }
+
+          if (!result) {
+            failedEntry = call.second;
+            throw runtime_error("output sink failed");
+          }
+        });
+
+    auto reportWriteError = [&] {
+      m_LastError          = Error::ERROR_LIBRARY_ERROR;
+      const auto sinkError = sink.errorMessage();
+      if (!sinkError.empty()) {
+        reportError(to_tstring(sinkError));
+      } else if (failedEntry != nullptr) {
+        reportError(format(BIT7Z_STRING("Error writing to {}: {}"),
+                           to_tstring(failedEntry->getArchiveFilePath().native()),
+                           writer.error().value_or("")));
+      } else {
+        reportError(writer.error().value_or(""));
+      }
+    };
+
+    for (const FileDataImpl* directory : directories) {
+      writer.push({SinkCall::BEGIN, directory}, nullptr, 0);
+      writer.push({SinkCall::END, directory}, nullptr, 0);
+    }
+
+    // set file callback
+    // currentEntry is required to know which entry is being extracted in the
+    // RawDataCallback
+    const FileDataImpl* currentEntry = nullptr;
+    tstring currentFile;
+    std::unordered_set<const FileDataImpl*> begun;
+
+    auto onFile = [&](const tstring& path) {
+      if (currentEntry != nullptr) {
+        writer.push({SinkCall::END, currentEntry}, nullptr, 0);
+      }
+
+      auto it     = fileMap.find(path);
+      currentEntry = it == fileMap.end() ? nullptr : it->second;
+      currentFile  = path;
+      if (currentEntry != nullptr) {
+        writer.push({SinkCall::BEGIN, currentEntry}, nullptr, 0);
+        begun.insert(currentEntry);
+      }
+
+      if (m_FileChangeCallback) {
+        m_FileChangeCallback(m_FileChangeType, fs::path(path));
+      }
+    };
+
+    if (m_ProgressCallback) {
+      m_ArchivePtr->setProgressCallback([this](const uint64_t current) {
+        return progressCallbackWrapper(current);
+      });
+    } else {
+      m_ArchivePtr->setProgressCallback({});
+    }
+
+    // we could test the archive if we wanted to by calling
+    // m_ArchivePtr->test();
+
+    // extract files
+    auto decodeEntries = [&] {
+      decode(indices, onFile, [&](const byte_t* data, const std::size_t size) -> bool {
+        if (decodeLimit) {
+          decodeLimit->consume(size, m_shouldCancel);
+        }
+        // data of entries that were not requested
+        if (currentEntry == nullptr) {
+          return true;
+        }
+        if (!writer.push({SinkCall::WRITE, currentEntry}, data, size)) {
+          reportWriteError();
+          return false;
+        }
+        return true;
+      });
+    };
+
+    if (!indices.empty()) {
+      if (lowPriority) {
+        runWithBackgroundPriority(decodeEntries);
+      } else {
+        decodeEntries();
+      }
+    }
+
+    if (currentEntry != nullptr) {
+      writer.push({SinkCall::END, currentEntry}, nullptr, 0);
+    }
+
+    // empty files are not necessarily reported by 7z
+    for (const auto& [path, fileData] : fileMap) {
+      if (!begun.contains(fileData)) {
+        writer.push({SinkCall::BEGIN, fileData}, nullptr, 0);
+        writer.push({SinkCall::END, fileData}, nullptr, 0);
+      }
+    }
+
+    if (writer.finish()) {
+      reportWriteError();
+      return false;
+    }
+
+    return true;
+  } catch (const BitException& ex) {
+    if (m_shouldCancel) {
+      m_LastError = Error::ERROR_EXTRACT_CANCELLED;
+    } else {
+      m_LastError = Error::ERROR_LIBRARY_ERROR;
+    }
+    reportError(ex.what());
+    return false;
+  }
+}
+
+bool ArchiveImpl::extractToMemory(std::span<FileData* const> entries,
+                                  std::span<const std::span<std::byte>> buffers,
+                                  ErrorCallback errorCallback)
+{
+  m_ErrorCallback = errorCallback;
+
+  if (buffers.size() != entries.size()) {
+    m_LastError = Error::ERROR_LIBRARY_ERROR;
+    reportError(format(BIT7Z_STRING("Expected {} buffers, got {}"), entries.size(),
+                       buffers.size()));
+    return false;
+  }
+
+  vector<MemoryTarget> targets;
+  targets.reserve(entries.size());
+  for (const auto& buffer : buffers) {
+    targets.push_back({buffer});
+  }
+
+  return extractToTargets(entries, targets);
+}
+
+bool ArchiveImpl::extractToMemory(std::span<FileData* const> entries,
+                                  std::vector<std::vector<std::byte>>& buffers,
+                                  ErrorCallback errorCallback)
+{
+  m_ErrorCallback = errorCallback;
+
+  buffers.clear();
+  buffers.resize(entries.size());
+
+  vector<MemoryTarget> targets;
+  targets.reserve(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i] != nullptr) {
+      buffers[i].reserve(entries[i]->getSize());
+    }
+    targets.push_back({{}, &buffers[i]});
+  }
+
+  return extractToTargets(entries, targets);
+}
+
+bool ArchiveImpl::extractToTargets(std::span<FileData* const> entries,
+                                   std::vector<MemoryTarget>& targets)
+{
+  if (!m_Valid || !ensureReader() || !checkNotStreaming()) {
+    return false;
+  }
+
+  // map archive paths to targets, like extract() does with output files
+  std::unordered_map<tstring, MemoryTarget*> targetMap;
+  vector<uint32_t> indices;
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    FileDataImpl* fileData = toFileDataImpl(entries[i]);
+    if (fileData == nullptr) {
+      m_LastError = Error::ERROR_LIBRARY_ERROR;
+      reportError(format(BIT7Z_STRING("Entry {} does not belong to this archive"), i));
+      return false;
+    }
+    if (fileData->isDirectory()) {
+      continue;
+    }
+
+    const tstring path = to_tstring(fileData->getArchiveFilePath().native());
+    if (!targetMap.emplace(path, &targets[i]).second) {
+      m_LastError = Error::ERROR_LIBRARY_ERROR;
+      reportError(format(BIT7Z_STRING("Error adding '{}' to file map"), path));
+      return false;
+    }
+    indices.push_back(fileData->index());
+  }
+
+  if (indices.empty()) {
+    return true;
+  }
+
+  // 7z expects the indices to be sorted
+  ranges::sort(indices);
+  prepareInputForExtraction(indices);
+
+  try {
+    tstring currentFile;
+    m_ArchivePtr->setProgressCallback({});
+
+    decode(
+        indices,
+        [&](const tstring& path) {
+          currentFile = path;
+        },
+        [&](const byte_t* data, const std::size_t size) -> bool {
+          auto it = targetMap.find(currentFile);
+          if (it == targetMap.end()) {
+            reportError(
+                format(BIT7Z_STRING("File {} not found in file map"), currentFile));
+            return false;
+          }
+
+          MemoryTarget& target = *it->second;
+          const auto* bytes    = reinterpret_cast<const std::byte*>(data);
+          if (target.owned != nullptr) {
+            target.owned->insert(target.owned->end(), bytes, bytes + size);
+          } else if (target.written + size <= target.buffer.size()) {
+            std::copy_n(bytes, size, target.buffer.begin() + target.written);
+          } else {
+            reportError(format(BIT7Z_STRING("Buffer too small to extract {}"),
+                               currentFile));
+            return false;
+          }
+          target.written += size;
+
+          return !m_shouldCancel.load();
+        });
+
+    return true;
+  } catch (const BitException& ex) {
+    if (m_shouldCancel) {
+      m_LastError = Error::ERROR_EXTRACT_CANCELLED;
+    } else {
+      m_LastError = Error::ERROR_LIBRARY_ERROR;
+    }
+    reportError(ex.what());
+    return false;
+  }
+}
+
+std::unique_ptr<EntryStream> ArchiveImpl::openEntry(FileData* entry)
+{
+  if (!m_Valid || !ensureReader() || !checkNotStreaming()) {
+    return nullptr;
+  }
+
+  FileDataImpl* fileData = toFileDataImpl(entry);
+  if (fileData == nullptr) {
+    m_LastError = Error::ERROR_LIBRARY_ERROR;
+    reportError(BIT7Z_STRING("Entry does not belong to this archive"));
+    return nullptr;
+  }
+  if (fileData->isDirectory()) {
+    m_LastError = Error::ERROR_LIBRARY_ERROR;
+    reportError(format(BIT7Z_STRING("Cannot open directory {}"),
+                       to_tstring(fileData->getArchiveFilePath().native())));
+    return nullptr;
+  }
+
+  // the callbacks of the previous extraction refer to its (now gone) state
+  m_ArchivePtr->setFileCallback({});
+  m_ArchivePtr->setProgressCallback({});
+  const uint32_t index = fileData->index();
+  prepareInputForExtraction({&index, 1});
+
+  // the stream shares the ownership of the reader, which stays busy until the entry
+  // has been decoded or the stream destroyed
+  auto holder       = shared_ptr<StreamArchiveReader>(m_ArchivePtr, m_Reader);
+  holder->streaming = true;
+
+  return make_unique<EntryStreamImpl>([holder, tarball = m_Tarball,
+                                        index](auto const& sink) {
+    struct StreamingGuard
+    {
+      ~StreamingGuard() { holder.streaming = false; }
+      StreamArchiveReader& holder;
+    } guard{*holder};
+
+    auto onData = [&sink](const byte_t* data, const std::size_t size) {
+      return sink(reinterpret_cast<const std::byte*>(data), size);
+    };
+    if (tarball) {
+      const uint32_t indices[] = {index};
+      tarball->extractTo(indices, [](const tstring&) {}, onData);
+    } else {
+      holder->reader->extractTo(onData, {index});
+    }
+  });
+}
+
+Generator<Archive::EntryChunk> ArchiveImpl::chunks(std::span<FileData* const> entries,
+                                                   ErrorCallback errorCallback)
+{
+  m_ErrorCallback = errorCallback;
+
+  if (!m_Valid || !ensureReader() || !checkNotStreaming()) {
+    co_return;
+  }
+
+  m_LastError = Error::ERROR_NONE;
+
+  std::unordered_map<tstring, FileDataImpl*> fileMap;
+  vector<FileDataImpl*> directories;
+  vector<uint32_t> indices;
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    FileDataImpl* fileData = toFileDataImpl(entries[i]);
+    if (fileData == nullptr) {
+      m_LastError = Error::ERROR_LIBRARY_ERROR;
+      reportError(format(BIT7Z_STRING("Entry {} does not belong to this archive"), i));
+      co_return;
+    }
+    if (fileData->isDirectory()) {
+      directories.push_back(fileData);
+      continue;
+    }
+
+    const tstring path = to_tstring(fileData->getArchiveFilePath().native());
+    if (!fileMap.emplace(path, fileData).second) {
+      m_LastError = Error::ERROR_LIBRARY_ERROR;
+      reportError(format(BIT7Z_STRING("Error adding '{}' to file map"), path));
+      co_return;
+    }
+    indices.push_back(fileData->index());
+  }
+
+  for (FileDataImpl* directory : directories) {
+    co_yield EntryChunk{directory, {}};
+  }
+
+  if (indices.empty()) {
+    co_return;
+  }
+
+  // 7z expects the indices to be sorted
+  ranges::sort(indices);
+  prepareInputForExtraction(indices);
+
+  // only accessed by the producer until it has finished
+  FileDataImpl* currentEntry = nullptr;
+  unordered_set<FileDataImpl*> decoded;
+  optional<tstring> error;
+
+  // the callbacks given to the reader refer to the frame of this coroutine, they are
+  // cleared when it ends or is destroyed early, after the producer has stopped
+  struct CallbackGuard
+  {
+    ~CallbackGuard()
+    {
+      reader->setFileCallback({});
+      reader->setProgressCallback({});
+    }
+    shared_ptr<BitArchiveReader> reader;
+  } callbackGuard{m_ArchivePtr};
+
+  m_ArchivePtr->setProgressCallback({});
+  auto onFile = [&](const tstring& path) {
+    auto it      = fileMap.find(path);
+    currentEntry = it != fileMap.end() ? it->second : nullptr;
+  };
+
+  // declared last so that it is stopped before the state above is destroyed
+  ChunkProducer producer;
+  producer.thread = jthread([&] {
+    try {
+      decode(
+          indices, onFile,
+          [&](const byte_t* data, const std::size_t size) -> bool {
+            if (currentEntry == nullptr) {
+              error = BIT7Z_STRING("Decoded data does not belong to a requested entry");
+              return false;
+            }
+            if (size == 0) {
+              return true;
+            }
+
+            decoded.insert(currentEntry);
+            const EntryChunk chunk{currentEntry,
+                                   {reinterpret_cast<const std::byte*>(data), size}};
+            return producer.rendezvous.put(chunk) && !m_shouldCancel.load();
+          });
+    } catch (const BitException& ex) {
+      if (!error) {
+        error = ex.what();
+      }
+    }
+    producer.rendezvous.finish();
+  });
+
+  while (auto chunk = producer.rendezvous.take()) {
+    co_yield *chunk;
+  }
+
+  if (error) {
+    if (m_shouldCancel) {
+      m_LastError = Error::ERROR_EXTRACT_CANCELLED;
+    } else {
+      m_LastError = Error::ERROR_LIBRARY_ERROR;
+    }
+    reportError(*error);
+    co_return;
+  }
+
+  // 7z does not call the data callback for entries without content
+  for (FileData* entry : entries) {
+    FileDataImpl* fileData = toFileDataImpl(entry);
+    if (!fileData->isDirectory() && decoded.insert(fileData).second) {
+      co_yield EntryChunk{fileData, {}};
+    }
+  }
+}
+
+void ArchiveImpl::cancel()
 {
   m_shouldCancel.store(true);
 }
@@ -432,5 +1746,10 @@ bool ArchiveImpl::progressCallbackWrapper(uint64_t current) const
 
 DLLEXPORT std::unique_ptr<Archive> CreateArchive()
 {
-  return std::make_unique<ArchiveImpl>();
+  return std::make_unique<ArchiveImpl>(nullptr);
+}
+
+DLLEXPORT std::unique_ptr<Archive> CreateArchive(std::shared_ptr<Executor> executor)
+{
+  return std::make_unique<ArchiveImpl>(std::move(executor));
 }
@@ -0,0 +1,210 @@
+#include "archive.h"
+#include "threadpool.h"
+
+#include <bit7z/bittypes.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+using namespace bit7z;
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+
+// state of a ListArchives() call, shared with the workers since they may still be
+// queued when the call returns
+struct ListingState
+{
+  ListingState(std::span<const fs::path> paths, Archive::OpenOptions const& options,
+               shared_ptr<ArchivePool> pool)
+      : paths(paths.begin(), paths.end()), options(options), pool(std::move(pool))
+  {}
+
+  // copied so that workers never refer to the arguments of the call
+  vector<fs::path> paths;
+  Archive::OpenOptions options;
+  shared_ptr<ArchivePool> pool;
+
+  // index of the next archive to list, and whether the caller has given up
+  atomic<size_t> next  = 0;
+  atomic<bool> stopped = false;
+
+  // listings waiting to be given to the callback
+  mutex doneMutex;
+  condition_variable ready;
+  deque<pair<size_t, ArchiveListing>> done;
+};
+
+ArchiveListing listArchive(ArchivePool& pool, fs::path const& archivePath,
+                           Archive::OpenOptions const& options)
+{
+  ArchiveListing listing;
+  listing.archivePath = archivePath;
+
+  auto archive = pool.acquire();
+  archive->setLogCallback([&](Archive::LogLevel level, native_string const& message) {
+    if (level == Archive::LogLevel::Error) {
+      listing.errorMessage = message;
+    }
+  });
+
+  if (!archive->isValid() || !archive->open(archivePath, nullptr, options)) {
+    listing.error = archive->getLastError();
+    return listing;
+  }
+  listing.errorMessage.clear();
+
+  const auto& files = archive->getFileList();
+  size_t pathsSize  = 0;
+  for (const FileData* file : files) {
+    pathsSize += file->getArchiveFilePathView().size();
+  }
+  listing.entries.reserve(files.size());
+  listing.paths.reserve(pathsSize);
+
+  for (const FileData* file : files) {
+    const auto path = file->getArchiveFilePathView();
+    listing.entries.push_back({file->getSize(), static_cast<uint32_t>(file->getCRC()),
+                               static_cast<uint32_t>(listing.paths.size()),
+                               static_cast<uint32_t>(path.size()),
+                               file->isDirectory()});
+    listing.paths.append(path);
+  }
+
+  return listing;
+}
+
+// listing of an archive that could not be listed
+ArchiveListing failedListing(fs::path const& archivePath, Archive::Error error,
+                             native_string message)
+{
+  ArchiveListing listing;
+  listing.archivePath  = archivePath;
+  listing.error        = error;
+  listing.errorMessage = std::move(message);
+  return listing;
+}
+
+/**
+ * @brief List the next archive that no worker has taken yet.
+ *
+ * @return false if there is none left, or the caller has given up.
+ */
+bool listNext(ListingState& state)
+{
+  const size_t index = state.next++;
+  if (index >= state.paths.size() || state.stopped) {
+    return false;
+  }
+
+  // whatever happens to one archive, the others are listed and the caller gets a
+  // listing for each
+  const auto& path = state.paths[index];
+  ArchiveListing listing;
+  try {
+    listing = listArchive(*state.pool, path, state.options);
+  } catch (const bad_alloc&) {
+    listing = failedListing(
+        path, Archive::Error::ERROR_OUT_OF_MEMORY,
+        to_native_string(BIT7Z_STRING("Not enough memory to list the archive")));
+  } catch (const exception& ex) {
+    listing = failedListing(path, Archive::Error::ERROR_LIBRARY_ERROR,
+                            to_native_string(ex.what()));
+  }
+
+  {
+    scoped_lock lock(state.doneMutex);
+    state.done.emplace_back(index, std::move(listing));
+  }
+  state.ready.notify_one();
+  return true;
+}
+
+void listArchives(ListingState& state)
+{
+  while (listNext(state)) {
+  }
+}
+
+}  // namespace
+
+DLLEXPORT void
+ListArchives(std::span<const std::filesystem::path> archivePaths,
+             std::function<void(std::size_t, ArchiveListing&&)> const& callback,
+             ListArchivesOptions const& options)
+{
+  if (archivePaths.empty()) {
+    return;
+  }
+
+  const auto executor = options.executor ? options.executor : defaultExecutor();
+
+  // the calling thread lists archives too, so tasks are only submitted for the others
+  const size_t taskCount =
+      min<size_t>(executor->concurrency(), archivePaths.size() - 1);
+
+  // each worker reuses the same archive from one archive file to the next
+  auto pool  = CreateArchivePool(taskCount + 1, options.executor);
+  auto state =
+      make_shared<ListingState>(archivePaths, options.openOptions, std::move(pool));
+
+  // the remaining archives are not listed if the callback throws
+  struct StopGuard
+  {
+    ~StopGuard() { state.stopped = true; }
+    ListingState& state;
+  } guard{*state};
+
+  for (size_t i = 0; i < taskCount; ++i) {
+    executor->submit([state] {
+      listArchives(*state);
+    });
+  }
+
+  for (size_t delivered = 0; delivered < archivePaths.size(); ++delivered) {
+    unique_lock lock(state->doneMutex);
+
+    // rather than waiting for the tasks, which may be queued behind busy threads of the
+    // executor or behind the task calling this, list the next archive here
+    while (state->done.empty()) {
+      lock.unlock();
+      const bool listed = listNext(*state);
+      lock.lock();
+
+      if (!listed) {
+        state->ready.wait(lock, [&] {
+          return !state->done.empty();
+        });
+      }
+    }
+
+    auto [index, listing] = std::move(state->done.front());
+    state->done.pop_front();
+    lock.unlock();
+
+    callback(index, std::move(listing));
+  }
+}
+
+DLLEXPORT std::vector<ArchiveListing>
+ListArchives(std::span<const std::filesystem::path> archivePaths,
+             ListArchivesOptions const& options)
+{
+  vector<ArchiveListing> listings(archivePaths.size());
+  ListArchives(
+      archivePaths,
+      [&](size_t index, ArchiveListing&& listing) {
+        listings[index] = std::move(listing);
+      },
+      options);
+  return listings;
+}
@@ -0,0 +1,89 @@
+#include "archive.h"
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+
+class ArchivePoolImpl final : public ArchivePool,
+                              public enable_shared_from_this<ArchivePoolImpl>
+{
+public:
+  ArchivePoolImpl(size_t maxIdle, shared_ptr<Executor> executor)
+      : m_MaxIdle(maxIdle), m_Executor(std::move(executor))
+  {
+    m_Idle.reserve(m_MaxIdle);
+  }
+
+  Handle acquire() override
+  {
+    unique_ptr<Archive> archive;
+    {
+      scoped_lock lock(m_Mutex);
+      if (!m_Idle.empty()) {
+        archive = std::move(m_Idle.back());
+        m_Idle.pop_back();
+      }
+    }
+
+    if (!archive) {
+      archive = CreateArchive(m_Executor);
+    }
+
+    // handles may outlive the pool, in which case their archive is destroyed
+    return Handle(archive.release(), [pool = weak_from_this()](Archive* archive) {
+      unique_ptr<Archive> owned(archive);
+      if (auto self = pool.lock()) {
+        self->release(std::move(owned));
+      }
+    });
+  }
+
+  [[nodiscard]] size_t idleCount() const override
+  {
+    scoped_lock lock(m_Mutex);
+    return m_Idle.size();
+  }
+
+private:
+  void release(unique_ptr<Archive> archive)
+  {
+    // archives that could not load the library would fail the same way again
+    if (!archive->isValid()) {
+      return;
+    }
+
+    archive->close();
+    archive->setLogCallback({});
+    archive->setExecutor(m_Executor);
+    archive->setExtractionLimits({});
+
+    scoped_lock lock(m_Mutex);
+    if (m_Idle.size() < m_MaxIdle) {
+      m_Idle.push_back(std::move(archive));
+    }
+  }
+
+  const size_t m_MaxIdle;
+  const shared_ptr<Executor> m_Executor;
+
+  mutable mutex m_Mutex;
+  vector<unique_ptr<Archive>> m_Idle;
+};
+
+}  // namespace
+
+DLLEXPORT std::shared_ptr<ArchivePool>
+CreateArchivePool(std::size_t maxIdle, std::shared_ptr<Executor> executor)
+{
+  if (maxIdle == 0) {
+    maxIdle = max<size_t>(thread::hardware_concurrency(), 1);
+  }
+  return make_shared<ArchivePoolImpl>(maxIdle, std::move(executor));
+}
@@ -0,0 +1,116 @@
+#include "archivetree.h"
+
+#include <unordered_map>
+
+using namespace std;
+
+namespace
+{
+// child of a node with a given name
+struct ChildKey
+{
+  uint32_t parent;
+  native_string_view name;
+
+  bool operator==(ChildKey const&) const = default;
+};
+
+struct ChildKeyHash
+{
+  size_t operator()(ChildKey const& key) const
+  {
+    return hash<native_string_view>{}(key.name) ^ (size_t{key.parent} * 0x9e3779b9);
+  }
+};
+
+bool isSeparator(native_string::value_type c)
+{
+  return c == '/' || c == '\\';
+}
+}  // namespace
+
+ArchiveTree buildArchiveTree(std::span<FileData* const> entries)
+{
+  ArchiveTree tree;
+  tree.nodes.reserve(entries.size() + 1);
+  ArchiveTree::Node root;
+  root.isDirectory = true;
+  tree.nodes.push_back(root);
+
+  unordered_map<ChildKey, uint32_t, ChildKeyHash> children;
+  children.reserve(entries.size());
+
+  // last child of each node, to link children in archive order
+  vector<uint32_t> lastChild{ArchiveTree::NO_NODE};
+  lastChild.reserve(entries.size() + 1);
+
+  for (FileData* entry : entries) {
+    const native_string_view path = entry->getArchiveFilePathView();
+
+    uint32_t node = 0;
+    size_t start  = 0;
+    while (start < path.size()) {
+      size_t end = start;
+      while (end < path.size() && !isSeparator(path[end])) {
+        ++end;
+      }
+      if (end == start) {
+        ++start;
+        continue;
+      }
+
+      const native_string_view name = path.substr(start, end - start);
+
+      // trailing separators do not start another component
+      bool last = true;
+      for (size_t i = end; i < path.size() && last; ++i) {
+        last = isSeparator(path[i]);
+      }
+
+      auto [it, inserted] = children.try_emplace(
+          {node, name}, static_cast<uint32_t>(tree.nodes.size()));
+      if (inserted) {
+        ArchiveTree::Node child;
+        child.name   = name;
+        child.parent = node;
+        tree.nodes.push_back(child);
+        lastChild.push_back(ArchiveTree::NO_NODE);
+
+        if (lastChild[node] == ArchiveTree::NO_NODE) {
+          tree.nodes[node].firstChild = it->second;
+        } else {
+          tree.nodes[lastChild[node]].nextSibling = it->second;
+        }
+        lastChild[node] = it->second;
+      }
+
+      node = it->second;
+      if (!last) {
+        // nodes with children are directories, even if their entry says otherwise
+        tree.nodes[node].isDirectory = true;
+      }
+      start = end;
+    }
+
+    // keep the first entry if several have the same path
+    auto& leaf = tree.nodes[node];
+    if (node != 0 && leaf.entry == nullptr) {
+      leaf.entry = entry;
+      leaf.isDirectory |= entry->isDirectory();
+      if (!entry->isDirectory()) {
+        leaf.size      = entry->getSize();
+        leaf.fileCount = 1;
+      }
+    }
+  }
+
+  // children come after their parent, so walking backwards completes every subtree
+  // before it is added to its parent
+  for (size_t i = tree.nodes.size() - 1; i > 0; --i) {
+    auto& parent = tree.nodes[tree.nodes[i].parent];
+    parent.size += tree.nodes[i].size;
+    parent.fileCount += tree.nodes[i].fileCount;
+  }
+
+  return tree;
+}
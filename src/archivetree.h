@@ -0,0 +1,11 @@
+#ifndef ARCHIVETREE_H
+#define ARCHIVETREE_H
+
+#include "archive.h"
+
+/**
+ * @brief Build the directory tree of the given entries in a single pass over them.
+ */
+ArchiveTree buildArchiveTree(std::span<FileData* const> entries);
+
+#endif  // ARCHIVETREE_H
@@ -0,0 +1,252 @@
+#include "casefold.h"
+
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CASEFOLD_SSE2
+#endif
+
+using namespace std;
+
+namespace
+{
+
+template <typename CharT>
+CharT foldAscii(CharT c, bool separators)
+{
+  if (c >= 'A' && c <= 'Z') {
+    return static_cast<CharT>(c - 'A' + 'a');
+  }
+  if (separators && c == '\\') {
+    return '/';
+  }
+  return c;
+}
+
+/**
+ * Fold the ASCII letters of the given text, and replace backslashes by '/' if
+ * separators is set.
+ *
+ * @return true if the text contains non-ASCII characters, which are left untouched.
+ */
+template <typename CharT>
+bool foldAsciiRange(CharT* text, size_t size, bool separators)
+{
+  size_t i         = 0;
+  bool hasNonAscii = false;
+
+#ifdef CASEFOLD_SSE2
+  if constexpr (sizeof(CharT) == 1 || sizeof(CharT) == 2) {
+    constexpr size_t LANES = 16 / sizeof(CharT);
+
+    // signed comparisons, so bytes above 0x7F and units above 0x7FFF are never
+    // letters
+    auto set = [](int value) {
+      if constexpr (sizeof(CharT) == 1) {
+        return _mm_set1_epi8(static_cast<char>(value));
+      } else {
+        return _mm_set1_epi16(static_cast<short>(value));
+      }
+    };
+    auto greater = [](__m128i a, __m128i b) {
+      if constexpr (sizeof(CharT) == 1) {
+        return _mm_cmpgt_epi8(a, b);
+      } else {
+        return _mm_cmpgt_epi16(a, b);
+      }
+    };
+    auto equal = [](__m128i a, __m128i b) {
+      if constexpr (sizeof(CharT) == 1) {
+        return _mm_cmpeq_epi8(a, b);
+      } else {
+        return _mm_cmpeq_epi16(a, b);
+      }
+    };
+    auto add = [](__m128i a, __m128i b) {
+      if constexpr (sizeof(CharT) == 1) {
+        return _mm_add_epi8(a, b);
+      } else {
+        return _mm_add_epi16(a, b);
+      }
+    };
+
+    const __m128i beforeA   = set('A' - 1);
+    const __m128i afterZ    = set('Z' + 1);
+    const __m128i caseBit   = set(0x20);
+    const __m128i backslash = set('\\');
+    const __m128i slashBits = set('/' ^ '\\');
+    const __m128i lastAscii = set(0x7F);
+    const __m128i zero      = _mm_setzero_si128();
+
+    __m128i nonAscii = zero;
+    for (; i + LANES <= size; i += LANES) {
+      auto* p   = reinterpret_cast<__m128i*>(text + i);
+      __m128i v = _mm_loadu_si128(p);
+
+      const __m128i upper = _mm_and_si128(greater(v, beforeA), greater(afterZ, v));
+      v                   = add(v, _mm_and_si128(upper, caseBit));
+      if (separators) {
+        v = _mm_xor_si128(v, _mm_and_si128(equal(v, backslash), slashBits));
+      }
+      _mm_storeu_si128(p, v);
+
+      // negative lanes are above 0x7F for bytes and 0x7FFF for units
+      nonAscii = _mm_or_si128(nonAscii, greater(zero, v));
+      if constexpr (sizeof(CharT) == 2) {
+        nonAscii = _mm_or_si128(nonAscii, greater(v, lastAscii));
+      }
+    }
+    hasNonAscii = _mm_movemask_epi8(nonAscii) != 0;
+  }
+#endif
+
+  for (; i < size; ++i) {
+    text[i] = foldAscii(text[i], separators);
+    hasNonAscii |= static_cast<make_unsigned_t<CharT>>(text[i]) > 0x7F;
+  }
+
+  return hasNonAscii;
+}
+
+// simple case folding of the letters of the Latin-1, Latin Extended-A, Greek and
+// Cyrillic blocks and of the fullwidth Latin letters, unlike towlower() it does not
+// depend on the locale; other characters are left as is
+char32_t foldLetter(char32_t c)
+{
+  if (c < 0x100) {
+    // Latin-1, except the multiplication sign
+    return c >= 0xC0 && c <= 0xDE && c != 0xD7 ? c + 0x20 : c;
+  }
+  if (c < 0x180) {
+    // Latin Extended-A pairs, except the dotted capital I which folds to ASCII
+    if ((c >= 0x100 && c <= 0x12F) || (c >= 0x132 && c <= 0x137) ||
+        (c >= 0x14A && c <= 0x177)) {
+      return c | 1;
+    }
+    if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E)) {
+      return c + (c & 1);
+    }
+    return c == 0x178 ? 0xFF : c;
+  }
+  if (c >= 0x386 && c <= 0x3AB) {
+    // Greek, with the accented capitals out of order
+    switch (c) {
+    case 0x386:
+      return 0x3AC;
+    case 0x388:
+    case 0x389:
+    case 0x38A:
+      return c + 0x25;
+    case 0x38C:
+      return 0x3CC;
+    case 0x38E:
+    case 0x38F:
+      return c + 0x3F;
+    default:
+      return c >= 0x391 && c != 0x3A2 ? c + 0x20 : c;
+    }
+  }
+  if (c == 0x3C2) {
+    // final sigma
+    return 0x3C3;
+  }
+  if (c >= 0x400 && c <= 0x4BF) {
+    // Cyrillic
+    if (c < 0x410) {
+      return c + 0x50;
+    }
+    if (c < 0x430) {
+      return c + 0x20;
+    }
+    if ((c >= 0x460 && c <= 0x481) || c >= 0x48A) {
+      return c | 1;
+    }
+    return c;
+  }
+  return c >= 0xFF21 && c <= 0xFF3A ? c + 0x20 : c;
+}
+
+size_t utf8Size(char32_t c)
+{
+  return c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+}
+
+// fold the non-ASCII characters of the given UTF-8 text, invalid sequences are left
+// as is
+void foldNonAscii(span<char> text)
+{
+  for (size_t i = 0; i < text.size();) {
+    const auto lead = static_cast<unsigned char>(text[i]);
+    const size_t size = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+    if (size == 1 || i + size > text.size()) {
+      ++i;
+      continue;
+    }
+
+    char32_t c = lead & (0x7F >> size);
+    bool valid = true;
+    for (size_t k = 1; k < size; ++k) {
+      const auto next = static_cast<unsigned char>(text[i + k]);
+      valid &= (next & 0xC0) == 0x80;
+      c = (c << 6) | (next & 0x3F);
+    }
+    if (!valid) {
+      ++i;
+      continue;
+    }
+
+    // first bits of the lead byte by size of the sequence
+    constexpr unsigned char LEAD[] = {0, 0, 0xC0, 0xE0, 0xF0};
+
+    const char32_t folded = foldLetter(c);
+    if (folded != c && utf8Size(folded) == size) {
+      for (size_t k = 1; k < size; ++k) {
+        const auto bits = (folded >> (6 * (size - 1 - k))) & 0x3F;
+        text[i + k]     = static_cast<char>(0x80 | bits);
+      }
+      text[i] = static_cast<char>(LEAD[size] | (folded >> (6 * (size - 1))));
+    }
+    i += size;
+  }
+}
+
+// fold the non-ASCII units of the given UTF-16 text, surrogates are left as is
+template <typename CharT>
+void foldNonAscii(span<CharT> text)
+{
+  for (auto& c : text) {
+    if (c > 0x7F && (c < 0xD800 || c > 0xDFFF)) {
+      c = static_cast<CharT>(foldLetter(c));
+    }
+  }
+}
+
+void fold(span<native_string::value_type> text, bool separators)
+{
+  if (foldAsciiRange(text.data(), text.size(), separators)) {
+    foldNonAscii(text);
+  }
+}
+
+}  // namespace
+
+native_string foldCase(native_string_view text)
+{
+  native_string result(text);
+  fold(result, false);
+  return result;
+}
+
+native_string makePathKey(native_string_view path)
+{
+  native_string key(path);
+  fold(key, true);
+
+  const auto first = key.find_first_not_of('/');
+  if (first == native_string::npos) {
+    return {};
+  }
+  const auto last = key.find_last_not_of('/');
+  return key.substr(first, last - first + 1);
+}
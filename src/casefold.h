@@ -0,0 +1,24 @@
+#ifndef CASEFOLD_H
+#define CASEFOLD_H
+
+#include "archive.h"
+
+/**
+ * @brief Fold the case of the given text.
+ *
+ * ASCII letters are folded a whole SSE2 register at a time when available. Other
+ * letters are folded whatever the locale for the Latin-1, Latin Extended-A, Greek and
+ * Cyrillic blocks and the fullwidth Latin letters only, each to a letter with an
+ * encoding of the same size, so folding never changes the length of a text.
+ */
+native_string foldCase(native_string_view text);
+
+/**
+ * @brief Compute the key of the given path for case-insensitive comparisons.
+ *
+ * Keys use '/' as separator, have no leading or trailing separator and are case
+ * folded, in a single pass over the path.
+ */
+native_string makePathKey(native_string_view path);
+
+#endif  // CASEFOLD_H
@@ -0,0 +1,40 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/// incremental CRC32 (ISO-HDLC, the one used by zip and 7z)
+class Crc32
+{
+public:
+  void update(std::span<const std::byte> data)
+  {
+    uint32_t crc = m_Value;
+    for (const std::byte byte : data) {
+      crc = TABLE[(crc ^ static_cast<uint8_t>(byte)) & 0xFF] ^ (crc >> 8);
+    }
+    m_Value = crc;
+  }
+
+  [[nodiscard]] uint32_t value() const { return ~m_Value; }
+
+private:
+  static constexpr std::array<uint32_t, 256> TABLE = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < table.size(); ++i) {
+      uint32_t value = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+      }
+      table[i] = value;
+    }
+    return table;
+  }();
+
+  uint32_t m_Value = 0xFFFFFFFFu;
+};
+
+#endif  // CRC32_H
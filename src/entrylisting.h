@@ -0,0 +1,35 @@
+#ifndef ENTRYLISTING_H
+#define ENTRYLISTING_H
+
+#include "archive.h"
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Properties of the entries of an archive that were read without the 7z handler of the
+ * archive (cached listing, tar headers of a compressed tarball), see EntryTable.
+ *
+ * Listings are never modified once created, so they can be read from several threads.
+ */
+class EntryListing
+{
+public:
+  [[nodiscard]] virtual uint32_t count() const = 0;
+
+  [[nodiscard]] virtual native_string_view path(uint32_t index) const = 0;
+  [[nodiscard]] virtual uint64_t size(uint32_t index) const = 0;
+  [[nodiscard]] virtual uint32_t crc(uint32_t index) const = 0;
+  [[nodiscard]] virtual bool isDirectory(uint32_t index) const = 0;
+  [[nodiscard]] virtual uint64_t packedSize(uint32_t index) const = 0;
+  [[nodiscard]] virtual std::chrono::system_clock::time_point
+  modified(uint32_t index) const = 0;
+  [[nodiscard]] virtual uint32_t attributes(uint32_t index) const = 0;
+  [[nodiscard]] virtual native_string_view method(uint32_t index) const = 0;
+  [[nodiscard]] virtual bool isEncrypted(uint32_t index) const = 0;
+  [[nodiscard]] virtual uint32_t block(uint32_t index) const = 0;
+
+  virtual ~EntryListing() = default;
+};
+
+#endif  // ENTRYLISTING_H
@@ -0,0 +1,137 @@
+#include "entrystream.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+EntryStreamImpl::EntryStreamImpl(Producer producer, std::size_t maxBufferedBytes)
+    : m_MaxBufferedBytes(maxBufferedBytes), m_StreamBuf(*this), m_Stream(&m_StreamBuf)
+{
+  m_Producer = jthread([this, producer = std::move(producer)] {
+    bool failed = false;
+    try {
+      producer([this](const std::byte* data, size_t size) {
+        return push(data, size);
+      });
+    } catch (...) {
+      failed = true;
+    }
+    finish(failed);
+  });
+}
+
+EntryStreamImpl::~EntryStreamImpl()
+{
+  {
+    scoped_lock lock(m_Mutex);
+    m_Closed = true;
+  }
+  m_SpaceAvailable.notify_all();
+}
+
+bool EntryStreamImpl::push(const std::byte* data, std::size_t size)
+{
+  unique_lock lock(m_Mutex);
+  m_SpaceAvailable.wait(lock, [this] {
+    return m_Closed || m_BufferedBytes < m_MaxBufferedBytes;
+  });
+  if (m_Closed) {
+    return false;
+  }
+
+  m_Chunks.emplace_back(data, data + size);
+  m_BufferedBytes += size;
+  lock.unlock();
+
+  m_DataAvailable.notify_one();
+  return true;
+}
+
+void EntryStreamImpl::finish(bool failed)
+{
+  {
+    scoped_lock lock(m_Mutex);
+    m_Finished = true;
+    // stopping because the stream was destroyed is not a failure
+    m_Failed = failed && !m_Closed;
+  }
+  m_DataAvailable.notify_all();
+}
+
+std::size_t EntryStreamImpl::read(std::span<std::byte> buffer)
+{
+  size_t total = 0;
+
+  unique_lock lock(m_Mutex);
+  while (total < buffer.size()) {
+    m_DataAvailable.wait(lock, [this] {
+      return m_Finished || !m_Chunks.empty();
+    });
+    if (m_Chunks.empty()) {
+      break;
+    }
+
+    auto& chunk       = m_Chunks.front();
+    const size_t size = min(buffer.size() - total, chunk.size() - m_FrontOffset);
+    memcpy(buffer.data() + total, chunk.data() + m_FrontOffset, size);
+    total += size;
+    m_FrontOffset += size;
+    m_BufferedBytes -= size;
+
+    if (m_FrontOffset == chunk.size()) {
+      m_Chunks.pop_front();
+      m_FrontOffset = 0;
+    }
+    m_SpaceAvailable.notify_one();
+  }
+
+  return total;
+}
+
+bool EntryStreamImpl::failed() const
+{
+  scoped_lock lock(m_Mutex);
+  return m_Failed;
+}
+
+EntryStreamImpl::StreamBuf::StreamBuf(EntryStreamImpl& stream)
+    : m_EntryStream(stream), m_Buffer(BUFFER_SIZE)
+{}
+
+EntryStreamImpl::StreamBuf::int_type EntryStreamImpl::StreamBuf::underflow()
+{
+  if (gptr() < egptr()) {
+    return traits_type::to_int_type(*gptr());
+  }
+
+  const size_t size = m_EntryStream.read(as_writable_bytes(span(m_Buffer)));
+  if (size == 0) {
+    return traits_type::eof();
+  }
+
+  setg(m_Buffer.data(), m_Buffer.data(), m_Buffer.data() + size);
+  return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize EntryStreamImpl::StreamBuf::xsgetn(char_type* s, std::streamsize count)
+{
+  // serve what is already buffered, then read large requests directly
+  const streamsize buffered = min<streamsize>(count, egptr() - gptr());
+  if (buffered > 0) {
+    memcpy(s, gptr(), static_cast<size_t>(buffered));
+    gbump(static_cast<int>(buffered));
+  }
+
+  if (buffered == count) {
+    return count;
+  }
+
+  const auto remaining = static_cast<size_t>(count - buffered);
+  if (remaining < m_Buffer.size()) {
+    return buffered + streambuf::xsgetn(s + buffered, count - buffered);
+  }
+
+  return buffered + static_cast<streamsize>(m_EntryStream.read(
+                        as_writable_bytes(span(s + buffered, remaining))));
+}
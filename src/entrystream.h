@@ -0,0 +1,84 @@
+#ifndef ENTRYSTREAM_H
+#define ENTRYSTREAM_H
+
+#include "archive.h"
+
+#include <condition_variable>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+/**
+ * EntryStream fed by a producer running on its own thread.
+ *
+ * The producer is given a sink to push the decoded data to, the sink blocks while too
+ * much data is buffered and returns false once the stream has been destroyed, in which
+ * case the producer should stop. Exceptions thrown by the producer mark the stream as
+ * failed.
+ *
+ * The producer has a dedicated thread rather than running on an Executor since it
+ * blocks until the reader catches up, which could starve a pool shared with the reader.
+ */
+class EntryStreamImpl : public EntryStream
+{
+public:
+  using Sink     = std::function<bool(const std::byte*, std::size_t)>;
+  using Producer = std::function<void(Sink const&)>;
+
+  // maximum amount of decoded data buffered ahead of the reader
+  static constexpr std::size_t DEFAULT_MAX_BUFFERED_BYTES = 4 * 1024 * 1024;
+
+  explicit EntryStreamImpl(Producer producer,
+                           std::size_t maxBufferedBytes = DEFAULT_MAX_BUFFERED_BYTES);
+  ~EntryStreamImpl() override;
+
+  std::size_t read(std::span<std::byte> buffer) override;
+  [[nodiscard]] bool failed() const override;
+  std::istream& stream() override { return m_Stream; }
+
+private:
+  // std::streambuf reading from the entry stream
+  class StreamBuf : public std::streambuf
+  {
+  public:
+    explicit StreamBuf(EntryStreamImpl& stream);
+
+  protected:
+    int_type underflow() override;
+    std::streamsize xsgetn(char_type* s, std::streamsize count) override;
+
+  private:
+    static constexpr std::size_t BUFFER_SIZE = 64 * 1024;
+
+    EntryStreamImpl& m_EntryStream;
+    std::vector<char_type> m_Buffer;
+  };
+
+  bool push(const std::byte* data, std::size_t size);
+  void finish(bool failed);
+
+  std::size_t m_MaxBufferedBytes;
+
+  mutable std::mutex m_Mutex;
+  std::condition_variable m_DataAvailable;
+  std::condition_variable m_SpaceAvailable;
+
+  std::deque<std::vector<std::byte>> m_Chunks;
+  std::size_t m_FrontOffset   = 0;
+  std::size_t m_BufferedBytes = 0;
+  bool m_Finished             = false;
+  bool m_Failed               = false;
+  bool m_Closed               = false;
+
+  StreamBuf m_StreamBuf;
+  std::istream m_Stream;
+
+  // must be the last member so the producer is joined before anything else is
+  // destroyed
+  std::jthread m_Producer;
+};
+
+#endif  // ENTRYSTREAM_H
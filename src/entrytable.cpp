@@ -0,0 +1,287 @@
+#include "entrytable.h"
+#include "casefold.h"
+
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+
+using namespace bit7z;
+using namespace std;
+
+namespace
+{
+// value of a property of an item, or an empty value if 7z cannot read it, so that one
+// broken entry does not fail the whole listing
+template <typename Getter>
+auto readProperty(Getter getter, std::invoke_result_t<Getter> fallback = {})
+{
+  try {
+    return getter();
+  } catch (const BitException&) {
+    return fallback;
+  }
+}
+}  // namespace
+
+void EntryTable::Batch::recycle()
+{
+  // once flags cannot be reset, so they are created again
+  for (auto& flag : loaded) {
+    destroy_at(&flag);
+    construct_at(&flag);
+  }
+  destroy_at(&keysLoaded);
+  construct_at(&keysLoaded);
+
+  paths.clear();
+  sizes.clear();
+  crcs.clear();
+  directories.clear();
+  packedSizes.clear();
+  modified.clear();
+  attributes.clear();
+  methods.clear();
+  encrypted.clear();
+  blocks.clear();
+  keys.clear();
+}
+
+void EntryTable::prepareBatches(uint32_t count)
+{
+  const size_t batchCount = (count + BATCH_SIZE - 1) / BATCH_SIZE;
+  if (batchCount > m_BatchCapacity) {
+    m_Batches       = make_unique<Batch[]>(batchCount);
+    m_BatchCapacity = batchCount;
+  } else {
+    for (size_t i = 0; i < batchCount; ++i) {
+      m_Batches[i].recycle();
+    }
+  }
+  m_Count = count;
+}
+
+void EntryTable::reset(std::shared_ptr<BitArchiveReader> reader)
+{
+  prepareBatches(reader->itemsCount());
+  m_Reader = std::move(reader);
+  m_Listing.reset();
+}
+
+void EntryTable::reset(std::shared_ptr<const EntryListing> listing)
+{
+  // only used for the keys
+  prepareBatches(listing->count());
+  m_Reader.reset();
+  m_Listing = std::move(listing);
+}
+
+void EntryTable::clear()
+{
+  // the batches are recycled by the next reset()
+  m_Count = 0;
+  m_Reader.reset();
+  m_Listing.reset();
+  m_Methods.clear();
+}
+
+EntryTable::Batch& EntryTable::load(uint32_t index, Property property) const
+{
+  Batch& batch = m_Batches[index / BATCH_SIZE];
+
+  call_once(batch.loaded[property], [&] {
+    const uint32_t first = index - index % BATCH_SIZE;
+    const uint32_t last  = min(first + BATCH_SIZE, m_Count);
+
+    scoped_lock lock(m_ReaderMutex);
+    for (uint32_t i = first; i < last; ++i) {
+      const auto item = m_Reader->itemAt(i);
+
+      switch (property) {
+      case PATH:
+        batch.paths.push_back(readProperty([&] {
+          return to_native_string(item.path());
+        }));
+        break;
+      case SIZE:
+        batch.sizes.push_back(readProperty([&] {
+          return item.size();
+        }));
+        break;
+      case CRC:
+        batch.crcs.push_back(readProperty([&] {
+          return item.crc();
+        }));
+        break;
+      case DIRECTORY:
+        batch.directories.push_back(readProperty([&] {
+          return item.isDir();
+        }));
+        break;
+      case PACKED_SIZE:
+        batch.packedSizes.push_back(readProperty([&] {
+          return item.packSize();
+        }));
+        break;
+      case MODIFIED:
+        batch.modified.push_back(readProperty([&] {
+          return item.lastWriteTime();
+        }));
+        break;
+      case ATTRIBUTES:
+        batch.attributes.push_back(readProperty([&] {
+          return item.attributes();
+        }));
+        break;
+      case METHOD:
+        batch.methods.push_back(internMethod(readProperty([&] {
+          const auto method = item.itemProperty(BitProperty::Method);
+          return method.isEmpty() ? native_string()
+                                  : to_native_string(method.getString());
+        })));
+        break;
+      case ENCRYPTED:
+        batch.encrypted.push_back(readProperty([&] {
+          return item.isEncrypted();
+        }));
+        break;
+      case BLOCK:
+        batch.blocks.push_back(readProperty(
+            [&] {
+              const auto block = item.itemProperty(BitProperty::Block);
+              return block.isEmpty() ? FileData::NO_BLOCK : block.getUInt32();
+            },
+            FileData::NO_BLOCK));
+        break;
+      case PROPERTY_COUNT:
+        break;
+      }
+    }
+
+    batch.paths.shrink_to_fit();
+  });
+
+  return batch;
+}
+
+native_string_view EntryTable::path(uint32_t index) const
+{
+  if (m_Listing) {
+    return m_Listing->path(index);
+  }
+  return load(index, PATH).paths[index % BATCH_SIZE];
+}
+
+native_string_view EntryTable::key(uint32_t index) const
+{
+  Batch& batch = m_Batches[index / BATCH_SIZE];
+
+  call_once(batch.keysLoaded, [&] {
+    const uint32_t first = index - index % BATCH_SIZE;
+    const uint32_t last  = min(first + BATCH_SIZE, m_Count);
+
+    batch.keys.reserve(last - first);
+    for (uint32_t i = first; i < last; ++i) {
+      batch.keys.push_back(makePathKey(path(i)));
+    }
+    batch.keys.shrink_to_fit();
+  });
+
+  return batch.keys[index % BATCH_SIZE];
+}
+
+uint64_t EntryTable::size(uint32_t index) const
+{
+  if (m_Listing) {
+    return m_Listing->size(index);
+  }
+  return load(index, SIZE).sizes[index % BATCH_SIZE];
+}
+
+uint32_t EntryTable::crc(uint32_t index) const
+{
+  if (m_Listing) {
+    return m_Listing->crc(index);
+  }
+  return load(index, CRC).crcs[index % BATCH_SIZE];
+}
+
+bool EntryTable::isDirectory(uint32_t index) const
+{
+  if (m_Listing) {
+    return m_Listing->isDirectory(index);
+  }
+  return load(index, DIRECTORY).directories[index % BATCH_SIZE];
+}
+
+uint64_t EntryTable::packedSize(uint32_t index) const
+{
+  if (m_Listing) {
+    return m_Listing->packedSize(index);
+  }
+  return load(index, PACKED_SIZE).packedSizes[index % BATCH_SIZE];
+}
+
+std::chrono::system_clock::time_point EntryTable::modified(uint32_t index) const
+{
+  if (m_Listing) {
+    return m_Listing->modified(index);
+  }
+  return load(index, MODIFIED).modified[index % BATCH_SIZE];
+}
+
+uint32_t EntryTable::attributes(uint32_t index) const
+{
+  if (m_Listing) {
+    return m_Listing->attributes(index);
+  }
+  return load(index, ATTRIBUTES).attributes[index % BATCH_SIZE];
+}
+
+native_string_view EntryTable::method(uint32_t index) const
+{
+  if (m_Listing) {
+    return m_Listing->method(index);
+  }
+  return load(index, METHOD).methods[index % BATCH_SIZE];
+}
+
+bool EntryTable::isEncrypted(uint32_t index) const
+{
+  if (m_Listing) {
+    return m_Listing->isEncrypted(index);
+  }
+  return load(index, ENCRYPTED).encrypted[index % BATCH_SIZE];
+}
+
+uint32_t EntryTable::block(uint32_t index) const
+{
+  if (m_Listing) {
+    return m_Listing->block(index);
+  }
+  return load(index, BLOCK).blocks[index % BATCH_SIZE];
+}
+
+native_string_view EntryTable::internMethod(native_string method) const
+{
+  // only called while loading, with the reader mutex held
+  return *m_Methods.insert(std::move(method)).first;
+}
+
+void EntryTable::loadEntries(std::span<const uint32_t> indices) const
+{
+  if (m_Listing) {
+    return;
+  }
+
+  // the indices are sorted, so each batch is only visited once
+  uint32_t next = 0;
+  for (const uint32_t index : indices) {
+    if (index < next) {
+      continue;
+    }
+    for (int property = 0; property < PROPERTY_COUNT; ++property) {
+      load(index, static_cast<Property>(property));
+    }
+    next = index - index % BATCH_SIZE + BATCH_SIZE;
+  }
+}
@@ -0,0 +1,141 @@
+#ifndef ENTRYTABLE_H
+#define ENTRYTABLE_H
+
+#include "archive.h"
+#include "entrylisting.h"
+#include "pathtable.h"
+
+#include <bit7z/bitarchivereader.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Properties of the entries of an archive, read from 7z on first access.
+ *
+ * Each property is read for a whole batch of consecutive entries at once, so that
+ * opening an archive only costs parsing its headers while listing every entry still
+ * amortizes the calls to 7z. Loaded batches are never modified, so the paths remain
+ * valid until the table is reset.
+ *
+ * Properties may be read from several threads, but not while the reader is
+ * extracting, see loadEntries().
+ *
+ * The properties can also come from a listing read without the reader (cached listing,
+ * headers of a compressed tarball), in which case it is not used.
+ *
+ * Batches are kept when the table is cleared or reset, and reused by the next archive,
+ * so that reopening archives of similar sizes does not allocate them again.
+ */
+class EntryTable
+{
+public:
+  static constexpr uint32_t BATCH_SIZE = 4096;
+
+  /**
+   * @brief Drop the loaded properties and use the given reader from now on.
+   */
+  void reset(std::shared_ptr<bit7z::BitArchiveReader> reader);
+
+  /**
+   * @brief Drop the loaded properties and read them from the given listing.
+   */
+  void reset(std::shared_ptr<const EntryListing> listing);
+
+  void clear();
+
+  [[nodiscard]] uint32_t count() const { return m_Count; }
+
+  [[nodiscard]] native_string_view path(uint32_t index) const;
+
+  /**
+   * @return the key of the path of the given entry, see makePathKey(). Keys are
+   *   computed from the paths by batches too.
+   */
+  [[nodiscard]] native_string_view key(uint32_t index) const;
+  [[nodiscard]] uint64_t size(uint32_t index) const;
+  [[nodiscard]] uint32_t crc(uint32_t index) const;
+  [[nodiscard]] bool isDirectory(uint32_t index) const;
+  [[nodiscard]] uint64_t packedSize(uint32_t index) const;
+  [[nodiscard]] std::chrono::system_clock::time_point modified(uint32_t index) const;
+  [[nodiscard]] uint32_t attributes(uint32_t index) const;
+  [[nodiscard]] native_string_view method(uint32_t index) const;
+  [[nodiscard]] bool isEncrypted(uint32_t index) const;
+  [[nodiscard]] uint32_t block(uint32_t index) const;
+
+  /**
+   * @brief Load every property of the batches containing the given entries, before
+   *   extracting them with the reader.
+   *
+   * @param indices Indices of the entries, sorted.
+   */
+  void loadEntries(std::span<const uint32_t> indices) const;
+
+private:
+  enum Property
+  {
+    PATH,
+    SIZE,
+    CRC,
+    DIRECTORY,
+    PACKED_SIZE,
+    MODIFIED,
+    ATTRIBUTES,
+    METHOD,
+    ENCRYPTED,
+    BLOCK,
+    PROPERTY_COUNT
+  };
+
+  struct Batch
+  {
+    std::once_flag loaded[PROPERTY_COUNT];
+
+    PathTable paths;
+    std::vector<uint64_t> sizes;
+    std::vector<uint32_t> crcs;
+    std::vector<bool> directories;
+    std::vector<uint64_t> packedSizes;
+    std::vector<std::chrono::system_clock::time_point> modified;
+    std::vector<uint32_t> attributes;
+    std::vector<native_string_view> methods;
+    std::vector<bool> encrypted;
+    std::vector<uint32_t> blocks;
+
+    // keys are computed from the paths and do not need the reader
+    std::once_flag keysLoaded;
+    PathTable keys;
+
+    // drop the loaded properties, keeping the memory of the vectors
+    void recycle();
+  };
+
+  // get m_Batches ready for the given number of entries
+  void prepareBatches(uint32_t count);
+
+  // the given method name, stored once for the whole archive
+  native_string_view internMethod(native_string method) const;
+
+  // the batch of the given entry, with the given property loaded
+  Batch& load(uint32_t index, Property property) const;
+
+  // 7z handlers cannot be queried from several threads at once
+  mutable std::mutex m_ReaderMutex;
+
+  std::shared_ptr<bit7z::BitArchiveReader> m_Reader;
+  std::shared_ptr<const EntryListing> m_Listing;
+  uint32_t m_Count = 0;
+  std::unique_ptr<Batch[]> m_Batches;
+  std::size_t m_BatchCapacity = 0;
+
+  // names of the compression methods, few and shared by many entries; the set is
+  // node-based so views to its elements remain valid
+  mutable std::unordered_set<native_string> m_Methods;
+};
+
+#endif  // ENTRYTABLE_H
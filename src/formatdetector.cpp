@@ -0,0 +1,124 @@
+#include "formatdetector.h"
+
+#include <algorithm>
+#include <string_view>
+
+using namespace bit7z;
+using namespace std;
+
+namespace
+{
+
+struct Signature
+{
+  size_t offset;
+  string_view magic;
+  const BitInFormat* format;
+};
+
+// checked in order, so a signature must come before the ones it starts with
+constexpr Signature SIGNATURES[] = {
+    {0, {"7z\xBC\xAF\x27\x1C", 6}, &BitFormat::SevenZip},
+    {0, {"Rar!\x1A\x07\x01\x00", 8}, &BitFormat::Rar5},
+    {0, {"Rar!\x1A\x07\x00", 7}, &BitFormat::Rar},
+    {0, {"PK\x03\x04", 4}, &BitFormat::Zip},
+    {0, {"PK\x05\x06", 4}, &BitFormat::Zip},  // empty archive
+    {0, {"PK\x07\x08", 4}, &BitFormat::Zip},  // spanned archive
+    {0, {"\x1F\x8B\x08", 3}, &BitFormat::GZip},
+    {0, {"BZh", 3}, &BitFormat::BZip2},
+    {0, {"\xFD" "7zXZ\x00", 6}, &BitFormat::Xz},
+    {0, {"MSCF\x00\x00\x00\x00", 8}, &BitFormat::Cab},
+    {0, {"MSWIM\x00\x00\x00", 8}, &BitFormat::Wim},
+    {0, {"xar!", 4}, &BitFormat::Xar},
+    {0, {"\xED\xAB\xEE\xDB", 4}, &BitFormat::Rpm},
+    {257, {"ustar", 5}, &BitFormat::Tar},
+};
+
+static_assert(ranges::all_of(SIGNATURES, [](Signature const& signature) {
+  return signature.offset + signature.magic.size() <= FormatDetector::HEADER_SIZE;
+}));
+
+struct ExtensionHint
+{
+  string_view extension;
+  const BitInFormat* format;
+};
+
+// formats whose signature is not in the header, if they have one
+constexpr ExtensionHint EXTENSION_HINTS[] = {
+    {".iso", &BitFormat::Iso},
+    {".lzma", &BitFormat::Lzma},
+};
+
+// signatures of single compressed streams, some of which 7z has no format for
+constexpr string_view COMPRESSOR_SIGNATURES[] = {
+    {"\x1F\x8B", 2},
+    {"BZh", 3},
+    {"\xFD" "7zXZ\x00", 6},
+    {"\x28\xB5\x2F\xFD", 4},  // zstd
+};
+
+// compressed streams without a signature
+constexpr string_view COMPRESSOR_EXTENSIONS[] = {".lzma", ".tlz"};
+
+// check if the extension of the path is the given lowercase one, ignoring case
+bool hasExtension(std::filesystem::path const& path, string_view extension)
+{
+  const auto& native = path.native();
+  if (native.size() < extension.size()) {
+    return false;
+  }
+
+  const size_t start = native.size() - extension.size();
+  for (size_t i = 0; i < extension.size(); ++i) {
+    auto c = native[start + i];
+    if (c >= 'A' && c <= 'Z') {
+      c = static_cast<decltype(c)>(c - 'A' + 'a');
+    }
+    if (c != static_cast<decltype(c)>(extension[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+BitInFormat const& FormatDetector::detect(std::span<const std::byte> header,
+                                          std::filesystem::path const& archiveName)
+{
+  const string_view start(reinterpret_cast<const char*>(header.data()), header.size());
+  for (const Signature& signature : SIGNATURES) {
+    if (start.size() >= signature.offset &&
+        start.substr(signature.offset).starts_with(signature.magic)) {
+      return *signature.format;
+    }
+  }
+
+  for (const ExtensionHint& hint : EXTENSION_HINTS) {
+    if (hasExtension(archiveName, hint.extension)) {
+      return *hint.format;
+    }
+  }
+
+  return BitFormat::Auto;
+}
+
+bool FormatDetector::canEncryptHeaders(bit7z::BitInFormat const& format)
+{
+  return format == BitFormat::SevenZip || format == BitFormat::Rar ||
+         format == BitFormat::Rar5;
+}
+
+bool FormatDetector::isCompressedStream(std::span<const std::byte> header,
+                                        std::filesystem::path const& archiveName)
+{
+  const string_view start(reinterpret_cast<const char*>(header.data()), header.size());
+  return ranges::any_of(COMPRESSOR_SIGNATURES,
+                        [&](string_view signature) {
+                          return start.starts_with(signature);
+                        }) ||
+         ranges::any_of(COMPRESSOR_EXTENSIONS, [&](string_view extension) {
+           return hasExtension(archiveName, extension);
+         });
+}
@@ -0,0 +1,51 @@
+#ifndef FORMATDETECTOR_H
+#define FORMATDETECTOR_H
+
+#include <bit7z/bitformat.hpp>
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+/**
+ * Detection of the format of archives from the signature at their start, so that 7z
+ * does not have to try its handlers one by one as with BitFormat::Auto.
+ */
+class FormatDetector
+{
+public:
+  // number of bytes at the start of an archive needed to check every signature
+  static constexpr std::size_t HEADER_SIZE = 262;
+
+  /**
+   * @brief Detect the format of an archive.
+   *
+   * Signatures are checked first. The extension of the archive is only used for the
+   * formats that have no signature close enough to the start.
+   *
+   * @param header Start of the archive, up to HEADER_SIZE bytes.
+   * @param archiveName Name of the archive, may be empty.
+   *
+   * @return the format of the archive, or BitFormat::Auto if it could not be detected.
+   */
+  static bit7z::BitInFormat const& detect(std::span<const std::byte> header,
+                                          std::filesystem::path const& archiveName);
+
+  /**
+   * @return true if archives of the given format can have encrypted headers, in which
+   *   case they cannot be opened without a password.
+   */
+  static bool canEncryptHeaders(bit7z::BitInFormat const& format);
+
+  /**
+   * @brief Check if an archive is a single compressed stream (gzip, bzip2, xz, zstd,
+   *   lzma) rather than a container of entries.
+   *
+   * @param header Start of the archive, up to HEADER_SIZE bytes.
+   * @param archiveName Name of the archive, may be empty.
+   */
+  static bool isCompressedStream(std::span<const std::byte> header,
+                                 std::filesystem::path const& archiveName);
+};
+
+#endif  // FORMATDETECTOR_H
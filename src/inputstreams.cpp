@@ -0,0 +1,276 @@
+#include "inputstreams.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __unix__
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+// resolve a seek relative to the given positions, -1 if it ends before the start
+int64_t seekTarget(int64_t offset, ios_base::seekdir direction, int64_t current,
+                   int64_t end)
+{
+  int64_t base = 0;
+  if (direction == ios_base::cur) {
+    base = current;
+  } else if (direction == ios_base::end) {
+    base = end;
+  }
+  const int64_t target = base + offset;
+  return target < 0 ? -1 : target;
+}
+}  // namespace
+
+#ifdef __unix__
+
+std::shared_ptr<FileInputStream>
+FileInputStream::open(std::filesystem::path const& path, std::error_code& ec)
+{
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    ec = error_code(errno, system_category());
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ec = error_code(errno, system_category());
+    ::close(fd);
+    return nullptr;
+  }
+
+  // archives are mostly read from start to end, this enlarges the kernel read-ahead
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  ec.clear();
+  return shared_ptr<FileInputStream>(
+      new FileInputStream(fd, static_cast<uint64_t>(st.st_size)));
+}
+
+FileInputStream::~FileInputStream()
+{
+  ::close(m_File);
+}
+
+std::size_t FileInputStream::read(uint64_t offset, std::span<std::byte> buffer)
+{
+  size_t total = 0;
+  while (total < buffer.size()) {
+    const ssize_t count = pread(m_File, buffer.data() + total, buffer.size() - total,
+                                static_cast<off_t>(offset + total));
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      break;
+    }
+    total += static_cast<size_t>(count);
+  }
+  return total;
+}
+
+void FileInputStream::willNeed(uint64_t offset, std::size_t size) const
+{
+  if (offset < m_Size) {
+    posix_fadvise(m_File, static_cast<off_t>(offset), static_cast<off_t>(size),
+                  POSIX_FADV_WILLNEED);
+  }
+}
+
+#else
+
+std::shared_ptr<FileInputStream>
+FileInputStream::open(std::filesystem::path const& path, std::error_code& ec)
+{
+  HANDLE file =
+      CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    ec = error_code(static_cast<int>(GetLastError()), system_category());
+    return nullptr;
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize)) {
+    ec = error_code(static_cast<int>(GetLastError()), system_category());
+    CloseHandle(file);
+    return nullptr;
+  }
+
+  ec.clear();
+  return shared_ptr<FileInputStream>(
+      new FileInputStream(file, static_cast<uint64_t>(fileSize.QuadPart)));
+}
+
+FileInputStream::~FileInputStream()
+{
+  CloseHandle(m_File);
+}
+
+std::size_t FileInputStream::read(uint64_t offset, std::span<std::byte> buffer)
+{
+  size_t total = 0;
+  while (total < buffer.size()) {
+    // the offset is given explicitly, so concurrent reads do not interfere
+    OVERLAPPED overlapped{};
+    overlapped.Offset     = static_cast<DWORD>(offset + total);
+    overlapped.OffsetHigh = static_cast<DWORD>((offset + total) >> 32);
+
+    const auto toRead =
+        static_cast<DWORD>(min<size_t>(buffer.size() - total, 1u << 30));
+    DWORD count = 0;
+    if (!ReadFile(m_File, buffer.data() + total, toRead, &count, &overlapped) ||
+        count == 0) {
+      break;
+    }
+    total += count;
+  }
+  return total;
+}
+
+void FileInputStream::willNeed(uint64_t, std::size_t) const
+{
+  // FILE_FLAG_SEQUENTIAL_SCAN already makes the cache manager read ahead
+}
+
+#endif
+
+SpanStreamBuf::SpanStreamBuf(std::span<const std::byte> data)
+{
+  // the get area is never written to
+  auto* begin = const_cast<char_type*>(reinterpret_cast<const char_type*>(data.data()));
+  setg(begin, begin, begin + data.size());
+}
+
+SpanStreamBuf::pos_type SpanStreamBuf::seekoff(off_type offset,
+                                               std::ios_base::seekdir direction,
+                                               std::ios_base::openmode mode)
+{
+  if (!(mode & ios_base::in)) {
+    return pos_type(off_type(-1));
+  }
+
+  const int64_t target =
+      seekTarget(offset, direction, gptr() - eback(), egptr() - eback());
+  if (target < 0 || target > egptr() - eback()) {
+    return pos_type(off_type(-1));
+  }
+
+  setg(eback(), eback() + target, egptr());
+  return pos_type(target);
+}
+
+SpanStreamBuf::pos_type SpanStreamBuf::seekpos(pos_type position,
+                                               std::ios_base::openmode mode)
+{
+  return seekoff(off_type(position), ios_base::beg, mode);
+}
+
+InputStreamBuf::InputStreamBuf(std::shared_ptr<InputStream> stream,
+                               std::size_t bufferSize, std::vector<char_type> buffer)
+    : m_Stream(std::move(stream)), m_Buffer(std::move(buffer))
+{
+  // the content of a reused buffer does not matter, it is only resized
+  m_Buffer.resize(bufferSize);
+  reset(0);
+}
+
+std::vector<InputStreamBuf::char_type> InputStreamBuf::releaseBuffer()
+{
+  auto buffer = std::move(m_Buffer);
+  m_Buffer.clear();
+  reset(0);
+  return buffer;
+}
+
+void InputStreamBuf::reset(uint64_t position)
+{
+  m_BufferOffset = position;
+  setg(m_Buffer.data(), m_Buffer.data(), m_Buffer.data());
+}
+
+InputStreamBuf::int_type InputStreamBuf::underflow()
+{
+  if (gptr() < egptr()) {
+    return traits_type::to_int_type(*gptr());
+  }
+
+  reset(position());
+  const size_t size = m_Stream->read(m_BufferOffset, as_writable_bytes(span(m_Buffer)));
+  if (size == 0) {
+    return traits_type::eof();
+  }
+
+  setg(m_Buffer.data(), m_Buffer.data(), m_Buffer.data() + size);
+  return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize InputStreamBuf::xsgetn(char_type* s, std::streamsize count)
+{
+  // serve what is already buffered, then read large requests directly
+  const streamsize buffered = min<streamsize>(count, egptr() - gptr());
+  if (buffered > 0) {
+    memcpy(s, gptr(), static_cast<size_t>(buffered));
+    gbump(static_cast<int>(buffered));
+  }
+
+  if (buffered == count) {
+    return count;
+  }
+
+  const auto remaining = static_cast<size_t>(count - buffered);
+  if (remaining < m_Buffer.size()) {
+    return buffered + streambuf::xsgetn(s + buffered, count - buffered);
+  }
+
+  const uint64_t start = position();
+  const size_t size =
+      m_Stream->read(start, as_writable_bytes(span(s + buffered, remaining)));
+  reset(start + size);
+  return buffered + static_cast<streamsize>(size);
+}
+
+InputStreamBuf::pos_type InputStreamBuf::seekoff(off_type offset,
+                                                 std::ios_base::seekdir direction,
+                                                 std::ios_base::openmode mode)
+{
+  if (!(mode & ios_base::in)) {
+    return pos_type(off_type(-1));
+  }
+
+  const int64_t target =
+      seekTarget(offset, direction, static_cast<int64_t>(position()),
+                 static_cast<int64_t>(m_Stream->size()));
+  if (target < 0) {
+    return pos_type(off_type(-1));
+  }
+
+  // keep the buffered data if the target is inside of it
+  const auto newPosition = static_cast<uint64_t>(target);
+  if (newPosition >= m_BufferOffset &&
+      newPosition <= m_BufferOffset + static_cast<uint64_t>(egptr() - eback())) {
+    setg(eback(), eback() + (newPosition - m_BufferOffset), egptr());
+  } else {
+    reset(newPosition);
+  }
+
+  return pos_type(target);
+}
+
+InputStreamBuf::pos_type InputStreamBuf::seekpos(pos_type position,
+                                                 std::ios_base::openmode mode)
+{
+  return seekoff(off_type(position), ios_base::beg, mode);
+}
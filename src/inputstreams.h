@@ -0,0 +1,112 @@
+#ifndef INPUTSTREAMS_H
+#define INPUTSTREAMS_H
+
+#include "archive.h"
+
+#include <filesystem>
+#include <streambuf>
+#include <system_error>
+#include <vector>
+
+/**
+ * InputStream over a file, read with positional reads so that several threads can
+ * read from it at once.
+ */
+class FileInputStream : public InputStream
+{
+public:
+  /**
+   * @brief Open the given file for reading.
+   *
+   * @return the stream, or a null pointer if the file could not be opened, in which
+   *   case ec is set.
+   */
+  static std::shared_ptr<FileInputStream> open(std::filesystem::path const& path,
+                                               std::error_code& ec);
+
+  ~FileInputStream() override;
+
+  FileInputStream(const FileInputStream&)            = delete;
+  FileInputStream& operator=(const FileInputStream&) = delete;
+
+  uint64_t size() const override { return m_Size; }
+  std::size_t read(uint64_t offset, std::span<std::byte> buffer) override;
+
+  /**
+   * @brief Hint the system that the given range will be read soon.
+   */
+  void willNeed(uint64_t offset, std::size_t size) const;
+
+private:
+#ifdef __unix__
+  using Handle = int;
+#else
+  using Handle = void*;
+#endif
+
+  FileInputStream(Handle file, uint64_t size) : m_File(file), m_Size(size) {}
+
+  Handle m_File;
+  uint64_t m_Size;
+};
+
+/**
+ * std::streambuf over a memory buffer, used to hand buffers to 7z without copying
+ * them.
+ */
+class SpanStreamBuf : public std::streambuf
+{
+public:
+  explicit SpanStreamBuf(std::span<const std::byte> data);
+
+protected:
+  pos_type seekoff(off_type offset, std::ios_base::seekdir direction,
+                   std::ios_base::openmode mode) override;
+  pos_type seekpos(pos_type position, std::ios_base::openmode mode) override;
+};
+
+/**
+ * Buffered std::streambuf over an InputStream, used to hand custom streams to 7z.
+ */
+class InputStreamBuf : public std::streambuf
+{
+public:
+  static constexpr std::size_t DEFAULT_BUFFER_SIZE = 256 * 1024;
+
+  // the buffer of a previous stream can be given to avoid allocating one, see
+  // releaseBuffer()
+  explicit InputStreamBuf(std::shared_ptr<InputStream> stream,
+                          std::size_t bufferSize = DEFAULT_BUFFER_SIZE,
+                          std::vector<char_type> buffer = {});
+
+  /**
+   * @brief Take the buffer of this stream, to reuse it for another one. Nothing can be
+   *   read from this stream afterwards.
+   */
+  std::vector<char_type> releaseBuffer();
+
+protected:
+  int_type underflow() override;
+  std::streamsize xsgetn(char_type* s, std::streamsize count) override;
+  pos_type seekoff(off_type offset, std::ios_base::seekdir direction,
+                   std::ios_base::openmode mode) override;
+  pos_type seekpos(pos_type position, std::ios_base::openmode mode) override;
+
+private:
+  // position of the next character to read in the stream
+  [[nodiscard]] uint64_t position() const
+  {
+    return m_BufferOffset + static_cast<uint64_t>(gptr() - eback());
+  }
+
+  // drop the buffered data and move to the given position
+  void reset(uint64_t position);
+
+  std::shared_ptr<InputStream> m_Stream;
+  std::vector<char_type> m_Buffer;
+
+  // position of the first character of the buffer in the stream
+  uint64_t m_BufferOffset = 0;
+};
+
+#endif  // INPUTSTREAMS_H
@@ -0,0 +1,349 @@
+#include "listingcache.h"
+
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <map>
+
+#ifdef __unix__
+#include <cerrno>
+#include <sys/stat.h>
+#else
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+constexpr char MAGIC[8]           = {'M', 'O', '2', 'L', 'I', 'S', 'T', '\0'};
+constexpr uint32_t FORMAT_VERSION = 2;
+constexpr uint32_t FLAG_DIRECTORY = 1;
+constexpr uint32_t FLAG_ENCRYPTED = 2;
+constexpr std::size_t CHAR_SIZE   = sizeof(native_string::value_type);
+
+constexpr std::size_t align8(std::size_t offset)
+{
+  return (offset + 7) & ~std::size_t{7};
+}
+}  // namespace
+
+struct ListingCache::Header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t charSize;
+  uint32_t count;
+  uint32_t keySize;
+  uint64_t size;
+  int64_t modified;
+  uint64_t device;
+  uint64_t fileId;
+  uint64_t stringsSize;
+};
+
+struct ListingCache::Record
+{
+  uint64_t size;
+  uint64_t packedSize;
+  int64_t modified;
+  uint32_t crc;
+  uint32_t flags;
+  uint32_t attributes;
+  uint32_t block;
+  uint32_t pathOffset;
+  uint32_t pathSize;
+  uint32_t methodOffset;
+  uint32_t methodSize;
+};
+
+#ifdef __unix__
+
+bool ListingCache::makeKey(std::filesystem::path const& archive, Key& key,
+                           std::error_code& ec)
+{
+  const fs::path absolute = fs::absolute(archive, ec);
+  if (ec) {
+    return false;
+  }
+
+  struct stat st;
+  if (stat(absolute.c_str(), &st) != 0) {
+    ec = error_code(errno, system_category());
+    return false;
+  }
+
+  key.path     = absolute.lexically_normal().native();
+  key.size     = static_cast<uint64_t>(st.st_size);
+  key.modified = static_cast<int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 +
+                 st.st_mtim.tv_nsec;
+  key.device   = static_cast<uint64_t>(st.st_dev);
+  key.fileId   = static_cast<uint64_t>(st.st_ino);
+  return true;
+}
+
+#else
+
+bool ListingCache::makeKey(std::filesystem::path const& archive, Key& key,
+                           std::error_code& ec)
+{
+  const fs::path absolute = fs::absolute(archive, ec);
+  if (ec) {
+    return false;
+  }
+
+  HANDLE file = CreateFileW(absolute.c_str(), 0,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    ec = error_code(static_cast<int>(GetLastError()), system_category());
+    return false;
+  }
+
+  BY_HANDLE_FILE_INFORMATION info;
+  const bool ok = GetFileInformationByHandle(file, &info);
+  if (!ok) {
+    ec = error_code(static_cast<int>(GetLastError()), system_category());
+  }
+  CloseHandle(file);
+  if (!ok) {
+    return false;
+  }
+
+  key.path = absolute.lexically_normal().native();
+  key.size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+  key.modified =
+      static_cast<int64_t>((static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime)
+                            << 32) |
+                           info.ftLastWriteTime.dwLowDateTime);
+  key.device = info.dwVolumeSerialNumber;
+  key.fileId = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+  return true;
+}
+
+#endif
+
+std::filesystem::path ListingCache::fileFor(std::filesystem::path const& directory,
+                                            Key const& key)
+{
+  // FNV-1a of the path, collisions are caught by the key stored in the file
+  uint64_t hash = 0xcbf29ce484222325;
+  for (const auto c : key.path) {
+    hash = (hash ^ static_cast<uint64_t>(c)) * 0x100000001b3;
+  }
+  return directory / format("{:016x}.listing", hash);
+}
+
+std::shared_ptr<ListingCache> ListingCache::load(std::filesystem::path const& file,
+                                                 Key const& key)
+{
+  error_code ec;
+  auto mapping = MappedFile::open(file, ec);
+  if (!mapping) {
+    return nullptr;
+  }
+  mapping->advise(MappedFile::Access::SEQUENTIAL);
+
+  const auto data = mapping->data();
+  Header header;
+  if (data.size() < sizeof(header)) {
+    return nullptr;
+  }
+  memcpy(&header, data.data(), sizeof(header));
+
+  if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != FORMAT_VERSION || header.charSize != CHAR_SIZE ||
+      header.size != key.size || header.modified != key.modified ||
+      header.device != key.device || header.fileId != key.fileId ||
+      header.keySize != key.path.size()) {
+    return nullptr;
+  }
+
+  const size_t keyOffset     = sizeof(Header);
+  const size_t recordsOffset = align8(keyOffset + header.keySize * CHAR_SIZE);
+  const size_t stringsOffset = recordsOffset + size_t{header.count} * sizeof(Record);
+  if (data.size() != stringsOffset + header.stringsSize * CHAR_SIZE) {
+    return nullptr;
+  }
+
+  // the archive may have been replaced by another file with the same identity
+  if (memcmp(data.data() + keyOffset, key.path.data(), header.keySize * CHAR_SIZE) !=
+      0) {
+    return nullptr;
+  }
+
+  const native_string_view strings(
+      reinterpret_cast<const native_string::value_type*>(data.data() + stringsOffset),
+      header.stringsSize);
+  shared_ptr<ListingCache> cache(new ListingCache(
+      std::move(mapping), header.count, data.data() + recordsOffset, strings));
+
+  // check every record once, so that accessors can trust them
+  const auto inStrings = [&](uint32_t offset, uint32_t size) {
+    return offset <= strings.size() && size <= strings.size() - offset;
+  };
+  for (uint32_t i = 0; i < cache->count(); ++i) {
+    const Record record = cache->record(i);
+    if (!inStrings(record.pathOffset, record.pathSize) ||
+        !inStrings(record.methodOffset, record.methodSize)) {
+      return nullptr;
+    }
+  }
+
+  return cache;
+}
+
+void ListingCache::save(std::filesystem::path const& file, Key const& key,
+                        std::span<FileData* const> entries, std::error_code& ec)
+{
+  Header header{};
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version  = FORMAT_VERSION;
+  header.charSize = CHAR_SIZE;
+  header.count    = static_cast<uint32_t>(entries.size());
+  header.keySize  = static_cast<uint32_t>(key.path.size());
+  header.size     = key.size;
+  header.modified = key.modified;
+  header.device   = key.device;
+  header.fileId   = key.fileId;
+
+  vector<Record> records;
+  records.reserve(entries.size());
+  native_string strings;
+
+  // methods are shared by most entries, so each one is only stored once
+  map<native_string, uint32_t, less<>> methods;
+
+  for (const FileData* entry : entries) {
+    const native_string_view path   = entry->getArchiveFilePathView();
+    const native_string_view method = entry->getCompressionMethod();
+
+    Record record{};
+    record.size       = entry->getSize();
+    record.packedSize = entry->getPackedSize();
+    record.modified   = entry->getModificationTime().time_since_epoch().count();
+    record.crc        = static_cast<uint32_t>(entry->getCRC());
+    record.flags      = (entry->isDirectory() ? FLAG_DIRECTORY : 0) |
+                   (entry->isEncrypted() ? FLAG_ENCRYPTED : 0);
+    record.attributes = entry->getAttributes();
+    record.block      = entry->getBlockIndex();
+    record.pathOffset = static_cast<uint32_t>(strings.size());
+    record.pathSize   = static_cast<uint32_t>(path.size());
+    strings.append(path);
+
+    auto it = methods.find(method);
+    if (it == methods.end()) {
+      it = methods.emplace(native_string(method), static_cast<uint32_t>(strings.size()))
+               .first;
+      strings.append(method);
+    }
+    record.methodOffset = it->second;
+    record.methodSize   = static_cast<uint32_t>(method.size());
+
+    records.push_back(record);
+  }
+  header.stringsSize = strings.size();
+
+  fs::create_directories(file.parent_path(), ec);
+  if (ec) {
+    return;
+  }
+
+  // write to a temporary file first so that readers never see a partial listing
+  fs::path temporary = file;
+  temporary += ".tmp";
+  {
+    ofstream out(temporary, ios::binary | ios::trunc);
+    const size_t keyEnd = sizeof(Header) + key.path.size() * CHAR_SIZE;
+    const char padding[8]{};
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(key.path.data()),
+              static_cast<streamsize>(key.path.size() * CHAR_SIZE));
+    out.write(padding, static_cast<streamsize>(align8(keyEnd) - keyEnd));
+    out.write(reinterpret_cast<const char*>(records.data()),
+              static_cast<streamsize>(records.size() * sizeof(Record)));
+    out.write(reinterpret_cast<const char*>(strings.data()),
+              static_cast<streamsize>(strings.size() * CHAR_SIZE));
+
+    if (!out.flush()) {
+      ec = make_error_code(errc::io_error);
+    }
+  }
+
+  if (!ec) {
+    fs::rename(temporary, file, ec);
+  }
+  if (ec) {
+    error_code ignored;
+    fs::remove(temporary, ignored);
+  }
+}
+
+ListingCache::ListingCache(std::shared_ptr<MappedFile> file, uint32_t count,
+                           const std::byte* records, native_string_view strings)
+    : m_File(std::move(file)), m_Count(count), m_Records(records), m_Strings(strings)
+{}
+
+ListingCache::Record ListingCache::record(uint32_t index) const
+{
+  Record record;
+  memcpy(&record, m_Records + size_t{index} * sizeof(Record), sizeof(Record));
+  return record;
+}
+
+native_string_view ListingCache::path(uint32_t index) const
+{
+  const Record entry = record(index);
+  return m_Strings.substr(entry.pathOffset, entry.pathSize);
+}
+
+uint64_t ListingCache::size(uint32_t index) const
+{
+  return record(index).size;
+}
+
+uint32_t ListingCache::crc(uint32_t index) const
+{
+  return record(index).crc;
+}
+
+bool ListingCache::isDirectory(uint32_t index) const
+{
+  return (record(index).flags & FLAG_DIRECTORY) != 0;
+}
+
+uint64_t ListingCache::packedSize(uint32_t index) const
+{
+  return record(index).packedSize;
+}
+
+std::chrono::system_clock::time_point ListingCache::modified(uint32_t index) const
+{
+  return chrono::system_clock::time_point(
+      chrono::system_clock::duration(record(index).modified));
+}
+
+uint32_t ListingCache::attributes(uint32_t index) const
+{
+  return record(index).attributes;
+}
+
+native_string_view ListingCache::method(uint32_t index) const
+{
+  const Record entry = record(index);
+  return m_Strings.substr(entry.methodOffset, entry.methodSize);
+}
+
+bool ListingCache::isEncrypted(uint32_t index) const
+{
+  return (record(index).flags & FLAG_ENCRYPTED) != 0;
+}
+
+uint32_t ListingCache::block(uint32_t index) const
+{
+  return record(index).block;
+}
@@ -0,0 +1,94 @@
+#ifndef LISTINGCACHE_H
+#define LISTINGCACHE_H
+
+#include "archive.h"
+#include "entrylisting.h"
+#include "mappedfile.h"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <system_error>
+
+/**
+ * Listing of an archive saved to disk, so that it can be listed again without 7z.
+ *
+ * The file is memory-mapped when loaded and read in place: it starts with a header
+ * identifying the archive, followed by one fixed-size record per entry and the
+ * strings (paths and compression methods) of the entries back to back. It is only
+ * meant to be read on the machine that wrote it.
+ */
+class ListingCache : public EntryListing
+{
+public:
+  /// identity of an archive file, a cached listing is only used for the same identity
+  struct Key
+  {
+    native_string path;
+    uint64_t size    = 0;
+    int64_t modified = 0;
+    uint64_t device  = 0;
+    uint64_t fileId  = 0;
+  };
+
+  /**
+   * @brief Compute the identity of the given archive file.
+   *
+   * @return true if the identity could be computed, false otherwise, in which case ec
+   *   is set.
+   */
+  static bool makeKey(std::filesystem::path const& archive, Key& key,
+                      std::error_code& ec);
+
+  /**
+   * @return the path of the cache file for the given key in the given directory.
+   */
+  static std::filesystem::path fileFor(std::filesystem::path const& directory,
+                                       Key const& key);
+
+  /**
+   * @brief Load the cached listing in the given file.
+   *
+   * @return the listing, or a null pointer if the file does not exist, is corrupted or
+   *   belongs to another version of the archive.
+   */
+  static std::shared_ptr<ListingCache> load(std::filesystem::path const& file,
+                                            Key const& key);
+
+  /**
+   * @brief Save the listing of the given entries to the given file.
+   */
+  static void save(std::filesystem::path const& file, Key const& key,
+                   std::span<FileData* const> entries, std::error_code& ec);
+
+  [[nodiscard]] uint32_t count() const override { return m_Count; }
+
+  [[nodiscard]] native_string_view path(uint32_t index) const override;
+  [[nodiscard]] uint64_t size(uint32_t index) const override;
+  [[nodiscard]] uint32_t crc(uint32_t index) const override;
+  [[nodiscard]] bool isDirectory(uint32_t index) const override;
+  [[nodiscard]] uint64_t packedSize(uint32_t index) const override;
+  [[nodiscard]] std::chrono::system_clock::time_point
+  modified(uint32_t index) const override;
+  [[nodiscard]] uint32_t attributes(uint32_t index) const override;
+  [[nodiscard]] native_string_view method(uint32_t index) const override;
+  [[nodiscard]] bool isEncrypted(uint32_t index) const override;
+  [[nodiscard]] uint32_t block(uint32_t index) const override;
+
+private:
+  struct Header;
+  struct Record;
+
+  ListingCache(std::shared_ptr<MappedFile> file, uint32_t count,
+               const std::byte* records, native_string_view strings);
+
+  [[nodiscard]] Record record(uint32_t index) const;
+
+  std::shared_ptr<MappedFile> m_File;
+  uint32_t m_Count;
+  const std::byte* m_Records;
+  native_string_view m_Strings;
+};
+
+#endif  // LISTINGCACHE_H
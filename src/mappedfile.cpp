@@ -0,0 +1,148 @@
+#include "mappedfile.h"
+
+#ifdef __unix__
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+using namespace std;
+
+#ifdef __unix__
+
+std::shared_ptr<MappedFile> MappedFile::open(std::filesystem::path const& path,
+                                             std::error_code& ec)
+{
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    ec = error_code(errno, system_category());
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ec = error_code(errno, system_category());
+    ::close(fd);
+    return nullptr;
+  }
+
+  const auto size = static_cast<size_t>(st.st_size);
+  void* data      = nullptr;
+
+  // empty files cannot be mapped
+  if (size > 0) {
+    data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      ec = error_code(errno, system_category());
+      ::close(fd);
+      return nullptr;
+    }
+  }
+
+  // the mapping stays valid once the descriptor is closed
+  ::close(fd);
+
+  ec.clear();
+  return shared_ptr<MappedFile>(
+      new MappedFile(static_cast<const std::byte*>(data), size));
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_Size > 0) {
+    munmap(const_cast<std::byte*>(m_Data), m_Size);
+  }
+}
+
+void MappedFile::advise(Access access) const
+{
+  if (m_Size == 0) {
+    return;
+  }
+
+  int advice = MADV_NORMAL;
+  switch (access) {
+  case Access::NORMAL:
+    advice = MADV_NORMAL;
+    break;
+  case Access::SEQUENTIAL:
+    advice = MADV_SEQUENTIAL;
+    break;
+  case Access::RANDOM:
+    advice = MADV_RANDOM;
+    break;
+  }
+  madvise(const_cast<std::byte*>(m_Data), m_Size, advice);
+}
+
+#else
+
+std::shared_ptr<MappedFile> MappedFile::open(std::filesystem::path const& path,
+                                             std::error_code& ec)
+{
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    ec = error_code(static_cast<int>(GetLastError()), system_category());
+    return nullptr;
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize)) {
+    ec = error_code(static_cast<int>(GetLastError()), system_category());
+    CloseHandle(file);
+    return nullptr;
+  }
+
+  const auto size = static_cast<size_t>(fileSize.QuadPart);
+  void* data      = nullptr;
+
+  // empty files cannot be mapped
+  if (size > 0) {
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+      ec = error_code(static_cast<int>(GetLastError()), system_category());
+      CloseHandle(file);
+      return nullptr;
+    }
+
+    data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr) {
+      ec = error_code(static_cast<int>(GetLastError()), system_category());
+    }
+
+    // the view stays valid once the handles are closed
+    CloseHandle(mapping);
+    if (data == nullptr) {
+      CloseHandle(file);
+      return nullptr;
+    }
+  }
+
+  CloseHandle(file);
+
+  ec.clear();
+  return shared_ptr<MappedFile>(
+      new MappedFile(static_cast<const std::byte*>(data), size));
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_Size > 0) {
+    UnmapViewOfFile(m_Data);
+  }
+}
+
+void MappedFile::advise(Access) const
+{
+  // there is no equivalent of madvise() for views, the cache manager already detects
+  // sequential reads
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <system_error>
+
+/// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+  // expected access pattern, used to tune read-ahead
+  enum class Access
+  {
+    NORMAL,
+    SEQUENTIAL,
+    RANDOM
+  };
+
+  /**
+   * @brief Map the given file.
+   *
+   * @return the mapping, or a null pointer if the file could not be mapped, in which
+   *   case ec is set.
+   */
+  static std::shared_ptr<MappedFile> open(std::filesystem::path const& path,
+                                          std::error_code& ec);
+
+  ~MappedFile();
+
+  MappedFile(const MappedFile&)            = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  [[nodiscard]] std::span<const std::byte> data() const { return {m_Data, m_Size}; }
+
+  /**
+   * @brief Hint the system about how the mapping will be read from now on.
+   */
+  void advise(Access access) const;
+
+private:
+  MappedFile(const std::byte* data, std::size_t size) : m_Data(data), m_Size(size) {}
+
+  const std::byte* m_Data;
+  std::size_t m_Size;
+};
+
+#endif  // MAPPEDFILE_H
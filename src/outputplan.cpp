@@ -0,0 +1,110 @@
+#include "outputplan.h"
+
+#include <bit7z/bittypes.hpp>
+
+#include <format>
+
+using namespace bit7z;
+using namespace std;
+
+namespace
+{
+bool isSeparator(native_string::value_type c)
+{
+  return c == '/' || c == '\\';
+}
+
+// check that the given path is relative and does not go up, so that it cannot escape
+// the output directory
+bool isSafeRelativePath(native_string_view path)
+{
+  if (path.empty() || isSeparator(path.front())) {
+    return false;
+  }
+
+  // drive letters and alternate data streams
+  if (path.find(':') != native_string_view::npos) {
+    return false;
+  }
+
+  size_t start = 0;
+  while (start <= path.size()) {
+    size_t end = start;
+    while (end < path.size() && !isSeparator(path[end])) {
+      ++end;
+    }
+    const auto component = path.substr(start, end - start);
+    if (component.size() == 2 && component[0] == '.' && component[1] == '.') {
+      return false;
+    }
+    start = end + 1;
+  }
+
+  return true;
+}
+}  // namespace
+
+bool OutputPlan::build(OutputMapping const& mapping, uint32_t entryCount,
+                       native_string& error)
+{
+  m_Paths.clear();
+  m_Paths.reserve(mapping.size());
+  m_First.assign(size_t{entryCount} + 1, 0);
+
+  // count the paths of each entry while checking them
+  size_t position = 0;
+  mapping.forEach([&](uint32_t index, native_string_view path) {
+    if (!error.empty()) {
+      return;
+    }
+    if (index >= entryCount) {
+      error = to_native_string(
+          format(BIT7Z_STRING("Mapping {}: entry {} does not exist, the archive has {} "
+                              "entries"),
+                 position, index, entryCount));
+      return;
+    }
+    if (!isSafeRelativePath(path)) {
+      error = to_native_string(
+          format(BIT7Z_STRING("Mapping {}: '{}' is not a relative path inside of the "
+                              "output directory"),
+                 position, to_tstring(native_string(path))));
+      return;
+    }
+
+    m_Paths.push_back(path);
+    ++m_First[index + 1];
+    ++position;
+  });
+
+  if (!error.empty()) {
+    m_Paths.clear();
+    m_First.clear();
+    return false;
+  }
+
+  for (size_t i = 1; i < m_First.size(); ++i) {
+    m_First[i] += m_First[i - 1];
+  }
+
+  // place the paths of each entry in its range, in the order of the mapping
+  m_Slots.resize(m_Paths.size());
+  vector<uint32_t> next(m_First.begin(), m_First.end() - 1);
+  position = 0;
+  mapping.forEach([&](uint32_t index, native_string_view) {
+    m_Slots[next[index]++] = static_cast<uint32_t>(position++);
+  });
+
+  return true;
+}
+
+std::vector<uint32_t> OutputPlan::entries() const
+{
+  vector<uint32_t> indices;
+  for (size_t i = 0; i + 1 < m_First.size(); ++i) {
+    if (m_First[i + 1] > m_First[i]) {
+      indices.push_back(static_cast<uint32_t>(i));
+    }
+  }
+  return indices;
+}
@@ -0,0 +1,58 @@
+#ifndef OUTPUTPLAN_H
+#define OUTPUTPLAN_H
+
+#include "archive.h"
+#include "pathtable.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/**
+ * Output paths of the entries of an archive, resolved from an OutputMapping and
+ * grouped by entry so that the paths of an entry are found in constant time.
+ */
+class OutputPlan
+{
+public:
+  /**
+   * @brief Check the given mapping and build the plan from it.
+   *
+   * @param mapping The mapping to resolve.
+   * @param entryCount Number of entries in the archive.
+   * @param error Set to the reason of the failure if the mapping is invalid.
+   *
+   * @return true if the mapping is valid, false otherwise.
+   */
+  bool build(OutputMapping const& mapping, uint32_t entryCount, native_string& error);
+
+  /**
+   * @return the indices of the entries with at least one path, sorted.
+   */
+  [[nodiscard]] std::vector<uint32_t> entries() const;
+
+  /**
+   * @return the positions of the paths of the given entry, to pass to path().
+   */
+  [[nodiscard]] std::span<const uint32_t> paths(uint32_t index) const
+  {
+    return std::span(m_Slots).subspan(m_First[index],
+                                      m_First[index + 1] - m_First[index]);
+  }
+
+  [[nodiscard]] native_string_view path(uint32_t position) const
+  {
+    return m_Paths[position];
+  }
+
+private:
+  // paths in the order of the mapping
+  PathTable m_Paths;
+
+  // positions in m_Paths grouped by entry, the paths of entry i being
+  // m_Slots[m_First[i]] to m_Slots[m_First[i + 1]]
+  std::vector<uint32_t> m_Slots;
+  std::vector<uint32_t> m_First;
+};
+
+#endif  // OUTPUTPLAN_H
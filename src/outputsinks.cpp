@@ -0,0 +1,278 @@
+#include "outputsinks.h"
+#include "crc32.h"
+
+#include <bit7z/bittypes.hpp>
+
+#include <fstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace bit7z;
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+
+/// writes entries to their output file paths, or to the paths of a plan
+class DiskSink : public OutputSink
+{
+public:
+  explicit DiskSink(fs::path outputDirectory)
+      : m_OutputDirectory(std::move(outputDirectory))
+  {}
+
+  DiskSink(fs::path outputDirectory, shared_ptr<const OutputPlan> plan,
+           function<uint32_t(FileData const&)> indexOf)
+      : m_OutputDirectory(std::move(outputDirectory)), m_Plan(std::move(plan)),
+        m_IndexOf(std::move(indexOf))
+  {}
+
+  bool beginEntry(FileData const& entry) override
+  {
+    if (m_Plan) {
+      for (const uint32_t position : m_Plan->paths(m_IndexOf(entry))) {
+        if (!open(entry, fs::path(m_Plan->path(position)))) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    for (const fs::path& outputFilePath : entry.getOutputFilePaths()) {
+      if (!open(entry, outputFilePath)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool write(FileData const& entry, span<const std::byte> data) override
+  {
+    try {
+      for (auto& stream : m_Outputs) {
+        stream.write(reinterpret_cast<const char*>(data.data()),
+                     static_cast<streamsize>(data.size()));
+      }
+      return true;
+    } catch (const ios_base::failure& ex) {
+      return fail(format(BIT7Z_STRING("Error writing to {}: {}"),
+                         to_tstring(entry.getArchiveFilePath().native()), ex.what()));
+    }
+  }
+
+  bool endEntry(FileData const& entry) override
+  {
+    try {
+      for (auto& stream : m_Outputs) {
+        stream.close();
+      }
+      m_Outputs.clear();
+      return true;
+    } catch (const ios_base::failure& ex) {
+      m_Outputs.clear();
+      return fail(format(BIT7Z_STRING("Error writing to {}: {}"),
+                         to_tstring(entry.getArchiveFilePath().native()), ex.what()));
+    }
+  }
+
+  native_string errorMessage() const override { return m_Error; }
+
+private:
+  // create the given output of the entry
+  bool open(FileData const& entry, fs::path const& outputFilePath)
+  {
+    error_code ec;
+    const fs::path path = m_OutputDirectory / outputFilePath;
+
+    if (entry.isDirectory()) {
+      fs::create_directories(path, ec);
+      if (ec) {
+        return fail(format(BIT7Z_STRING("Error creating directory '{}': {}"),
+                           to_tstring(path.native()), ec.message()));
+      }
+      return true;
+    }
+
+    if (outputFilePath.has_parent_path()) {
+      fs::create_directories(path.parent_path(), ec);
+      if (ec) {
+        return fail(format(BIT7Z_STRING("Error creating directory '{}': {}"),
+                           to_tstring(path.parent_path().native()), ec.message()));
+      }
+    }
+
+    ofstream ofs(path, ios::binary | ios::trunc);
+    try {
+      ofs.exceptions(ios::failbit | ios::badbit);
+    } catch (const ios_base::failure& ex) {
+      return fail(format(BIT7Z_STRING("Error opening '{}' for writing: {}"),
+                         to_tstring(path.native()), ex.what()));
+    }
+    m_Outputs.emplace_back(std::move(ofs));
+    return true;
+  }
+
+  bool fail(const tstring& message)
+  {
+    m_Error = to_native_string(message);
+    return false;
+  }
+
+  fs::path m_OutputDirectory;
+  shared_ptr<const OutputPlan> m_Plan;
+  function<uint32_t(FileData const&)> m_IndexOf;
+  vector<ofstream> m_Outputs;
+  native_string m_Error;
+};
+
+class MemorySinkImpl : public MemorySink
+{
+public:
+  bool beginEntry(FileData const& entry) override
+  {
+    m_Current = &m_Contents[&entry];
+    m_Current->clear();
+    m_Current->reserve(entry.getSize());
+    return true;
+  }
+
+  bool write(FileData const&, span<const std::byte> data) override
+  {
+    m_Current->insert(m_Current->end(), data.begin(), data.end());
+    return true;
+  }
+
+  bool endEntry(FileData const&) override
+  {
+    m_Current = nullptr;
+    return true;
+  }
+
+  const vector<std::byte>* content(FileData const& entry) const override
+  {
+    auto it = m_Contents.find(&entry);
+    return it == m_Contents.end() ? nullptr : &it->second;
+  }
+
+private:
+  unordered_map<const FileData*, vector<std::byte>> m_Contents;
+  vector<std::byte>* m_Current = nullptr;
+};
+
+class HashSinkImpl : public HashSink
+{
+public:
+  bool beginEntry(FileData const&) override
+  {
+    m_Crc = {};
+    m_Size = 0;
+    return true;
+  }
+
+  bool write(FileData const&, span<const std::byte> data) override
+  {
+    m_Crc.update(data);
+    m_Size += data.size();
+    return true;
+  }
+
+  bool endEntry(FileData const& entry) override
+  {
+    m_Hashes[&entry] = {m_Size, m_Crc.value()};
+    return true;
+  }
+
+  const Hash* hash(FileData const& entry) const override
+  {
+    auto it = m_Hashes.find(&entry);
+    return it == m_Hashes.end() ? nullptr : &it->second;
+  }
+
+private:
+  unordered_map<const FileData*, Hash> m_Hashes;
+  Crc32 m_Crc;
+  uint64_t m_Size = 0;
+};
+
+class TeeSink : public OutputSink
+{
+public:
+  explicit TeeSink(vector<shared_ptr<OutputSink>> sinks) : m_Sinks(std::move(sinks)) {}
+
+  bool beginEntry(FileData const& entry) override
+  {
+    return forward([&](OutputSink& sink) {
+      return sink.beginEntry(entry);
+    });
+  }
+
+  bool write(FileData const& entry, span<const std::byte> data) override
+  {
+    return forward([&](OutputSink& sink) {
+      return sink.write(entry, data);
+    });
+  }
+
+  bool endEntry(FileData const& entry) override
+  {
+    return forward([&](OutputSink& sink) {
+      return sink.endEntry(entry);
+    });
+  }
+
+  native_string errorMessage() const override
+  {
+    return m_FailedSink ? m_FailedSink->errorMessage() : native_string();
+  }
+
+private:
+  template <typename F>
+  bool forward(F&& call)
+  {
+    for (const auto& sink : m_Sinks) {
+      if (!call(*sink)) {
+        m_FailedSink = sink.get();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  vector<shared_ptr<OutputSink>> m_Sinks;
+  const OutputSink* m_FailedSink = nullptr;
+};
+
+}  // namespace
+
+DLLEXPORT std::shared_ptr<OutputSink>
+CreateDiskSink(std::filesystem::path const& outputDirectory)
+{
+  return std::make_shared<DiskSink>(outputDirectory);
+}
+
+std::shared_ptr<OutputSink>
+CreatePlannedDiskSink(std::filesystem::path const& outputDirectory,
+                      std::shared_ptr<const OutputPlan> plan,
+                      std::function<uint32_t(FileData const&)> indexOf)
+{
+  return std::make_shared<DiskSink>(outputDirectory, std::move(plan),
+                                    std::move(indexOf));
+}
+
+DLLEXPORT std::shared_ptr<MemorySink> CreateMemorySink()
+{
+  return std::make_shared<MemorySinkImpl>();
+}
+
+DLLEXPORT std::shared_ptr<HashSink> CreateHashSink()
+{
+  return std::make_shared<HashSinkImpl>();
+}
+
+DLLEXPORT std::shared_ptr<OutputSink>
+CreateTeeSink(std::vector<std::shared_ptr<OutputSink>> sinks)
+{
+  return std::make_shared<TeeSink>(std::move(sinks));
+}
@@ -0,0 +1,24 @@
+#ifndef OUTPUTSINKS_H
+#define OUTPUTSINKS_H
+
+#include "archive.h"
+#include "outputplan.h"
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+
+/**
+ * @brief Create a sink writing entries to the paths given by the plan, instead of
+ *   their output file paths.
+ *
+ * @param outputDirectory Directory the paths of the plan are relative to.
+ * @param plan Output paths of the entries.
+ * @param indexOf Function returning the index of an entry in the archive.
+ */
+std::shared_ptr<OutputSink>
+CreatePlannedDiskSink(std::filesystem::path const& outputDirectory,
+                      std::shared_ptr<const OutputPlan> plan,
+                      std::function<uint32_t(FileData const&)> indexOf);
+
+#endif  // OUTPUTSINKS_H
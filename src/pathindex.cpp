@@ -0,0 +1,118 @@
+#include "pathindex.h"
+#include "casefold.h"
+
+#include <algorithm>
+
+using namespace std;
+
+native_string PathIndex::normalize(native_string_view path)
+{
+  native_string result(path);
+  ranges::replace(result, '\\', '/');
+
+  const auto first = result.find_first_not_of('/');
+  if (first == native_string::npos) {
+    return {};
+  }
+  const auto last = result.find_last_not_of('/');
+  return result.substr(first, last - first + 1);
+}
+
+void PathIndex::build(std::span<FileData* const> entries)
+{
+  clear();
+
+  m_Entries.assign(entries.begin(), entries.end());
+  m_Paths.reserve(m_Entries.size());
+  m_FoldedPaths.reserve(m_Entries.size());
+
+  // the keys of the entries are folded once and kept by the entries themselves
+  for (FileData* entry : m_Entries) {
+    m_Paths.push_back(normalize(entry->getArchiveFilePathView()));
+    m_FoldedPaths.push_back(entry->getPathKey());
+  }
+
+  // views are only taken once the tables are complete, since they move while growing
+  const auto count = static_cast<uint32_t>(m_Entries.size());
+  m_ByPath.reserve(count);
+  m_ByFoldedPath.reserve(count);
+  m_Sorted.resize(count);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    m_ByPath.emplace(m_Paths[i], i);
+    m_ByFoldedPath.emplace(m_FoldedPaths[i], i);
+    m_Sorted[i] = i;
+  }
+
+  ranges::stable_sort(m_Sorted, {}, [this](uint32_t i) {
+    return m_FoldedPaths[i];
+  });
+
+  m_Built = true;
+}
+
+void PathIndex::clear()
+{
+  m_ByPath.clear();
+  m_ByFoldedPath.clear();
+  m_Sorted.clear();
+  m_Paths.clear();
+  m_FoldedPaths.clear();
+  m_Entries.clear();
+  m_Built = false;
+}
+
+FileData* PathIndex::find(native_string_view path, bool caseSensitive) const
+{
+  const auto& index = caseSensitive ? m_ByPath : m_ByFoldedPath;
+  const auto it     = index.find(caseSensitive ? normalize(path) : makePathKey(path));
+  return it != index.end() ? m_Entries[it->second] : nullptr;
+}
+
+std::vector<FileData*> PathIndex::listPrefix(native_string_view directory,
+                                             bool caseSensitive) const
+{
+  native_string prefix = normalize(directory);
+  if (!prefix.empty()) {
+    prefix += '/';
+  }
+  const native_string foldedPrefix = foldCase(prefix);
+
+  auto first = ranges::lower_bound(m_Sorted, native_string_view(foldedPrefix), {},
+                                   [this](uint32_t i) {
+                                     return m_FoldedPaths[i];
+                                   });
+
+  vector<FileData*> result;
+  for (auto it = first; it != m_Sorted.end(); ++it) {
+    if (!m_FoldedPaths[*it].starts_with(foldedPrefix)) {
+      break;
+    }
+    if (!caseSensitive || m_Paths[*it].starts_with(prefix)) {
+      result.push_back(m_Entries[*it]);
+    }
+  }
+  return result;
+}
+
+std::vector<std::vector<FileData*>> PathIndex::caseCollisions() const
+{
+  // entries with the same key are next to each other in m_Sorted
+  vector<vector<FileData*>> collisions;
+  for (size_t first = 0; first < m_Sorted.size();) {
+    size_t last = first + 1;
+    while (last < m_Sorted.size() &&
+           m_FoldedPaths[m_Sorted[last]] == m_FoldedPaths[m_Sorted[first]]) {
+      ++last;
+    }
+
+    if (last - first > 1) {
+      auto& group = collisions.emplace_back();
+      for (size_t i = first; i < last; ++i) {
+        group.push_back(m_Entries[m_Sorted[i]]);
+      }
+    }
+    first = last;
+  }
+  return collisions;
+}
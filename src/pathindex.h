@@ -0,0 +1,70 @@
+#ifndef PATHINDEX_H
+#define PATHINDEX_H
+
+#include "archive.h"
+#include "pathtable.h"
+
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Lookup structures over the paths of the entries of an archive.
+ *
+ * Paths are normalized to use '/' as separator, without leading or trailing
+ * separators. A hash index answers exact lookups, another one answers case-insensitive
+ * lookups by the keys of the entries (FileData::getPathKey()), and the entries sorted
+ * by key answer prefix queries.
+ */
+class PathIndex
+{
+public:
+  /**
+   * @brief Index the given entries, replacing the current index.
+   */
+  void build(std::span<FileData* const> entries);
+
+  void clear();
+
+  [[nodiscard]] bool isBuilt() const { return m_Built; }
+
+  /**
+   * @return the entry with the given path, or a null pointer if there is none. If
+   *   several entries have the same path, the first one is returned.
+   */
+  [[nodiscard]] FileData* find(native_string_view path, bool caseSensitive) const;
+
+  /**
+   * @return the entries under the given directory, in path order.
+   */
+  [[nodiscard]] std::vector<FileData*> listPrefix(native_string_view directory,
+                                                  bool caseSensitive) const;
+
+  /**
+   * @return the groups of entries with the same path when case is ignored, each in
+   *   the order of the indexed entries.
+   */
+  [[nodiscard]] std::vector<std::vector<FileData*>> caseCollisions() const;
+
+  /**
+   * @brief Normalize the given path, as done for the indexed paths.
+   */
+  static native_string normalize(native_string_view path);
+
+private:
+  std::vector<FileData*> m_Entries;
+
+  // normalized paths, and keys of the entries, by position in m_Entries
+  PathTable m_Paths;
+  std::vector<native_string_view> m_FoldedPaths;
+
+  // positions in m_Entries by path
+  std::unordered_map<native_string_view, uint32_t> m_ByPath;
+  std::unordered_map<native_string_view, uint32_t> m_ByFoldedPath;
+
+  // positions in m_Entries, sorted by case-folded path
+  std::vector<uint32_t> m_Sorted;
+
+  bool m_Built = false;
+};
+
+#endif  // PATHINDEX_H
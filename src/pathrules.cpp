@@ -0,0 +1,433 @@
+#include "archive.h"
+#include "casefold.h"
+#include "pathindex.h"
+
+#include <bit7z/bittypes.hpp>
+
+#include <algorithm>
+#include <format>
+#include <optional>
+#include <utility>
+#include <vector>
+
+using namespace bit7z;
+using namespace std;
+
+namespace
+{
+
+using char_type = native_string::value_type;
+
+// kind of a wildcard, captures are numbered separately for each kind
+enum CaptureKind
+{
+  CAPTURE_STAR,
+  CAPTURE_QUESTION,
+  CAPTURE_GLOBSTAR,
+  CAPTURE_KIND_COUNT
+};
+
+/// part of a compiled pattern or replacement
+struct Token
+{
+  enum Type
+  {
+    LITERAL,
+
+    // '*', any sequence of characters other than separators
+    STAR,
+
+    // '?', any character other than a separator
+    QUESTION,
+
+    // '**' at the end of a pattern, any sequence of characters
+    GLOBSTAR,
+
+    // '**/', empty or any sequence of characters ending with a separator, the
+    // separator is not captured
+    GLOBSTAR_DIRECTORY
+  };
+
+  Type type;
+
+  // text of literals, folded if the rules are case-insensitive
+  native_string text;
+
+  // index of the capture of wildcards, in the captures of the pattern
+  uint32_t capture = 0;
+};
+
+CaptureKind captureKind(Token::Type type)
+{
+  switch (type) {
+  case Token::STAR:
+    return CAPTURE_STAR;
+  case Token::QUESTION:
+    return CAPTURE_QUESTION;
+  default:
+    return CAPTURE_GLOBSTAR;
+  }
+}
+
+/**
+ * Split a pattern or a replacement into tokens.
+ *
+ * @return the tokens, or nothing if the text is invalid, in which case error is set.
+ */
+optional<vector<Token>> tokenize(native_string_view text, tstring& error)
+{
+  vector<Token> tokens;
+  auto appendLiteral = [&](char_type c) {
+    if (tokens.empty() || tokens.back().type != Token::LITERAL) {
+      tokens.push_back({Token::LITERAL, {}, 0});
+    }
+    tokens.back().text += c;
+  };
+
+  for (size_t i = 0; i < text.size(); ++i) {
+    const char_type c = text[i] == '\\' ? char_type('/') : text[i];
+    if (c == '?') {
+      tokens.push_back({Token::QUESTION, {}, 0});
+    } else if (c != '*') {
+      appendLiteral(c);
+    } else if (i + 1 < text.size() && text[i + 1] == '*') {
+      // '**' must be a whole component
+      const bool atStart = i == 0 || text[i - 1] == '/' || text[i - 1] == '\\';
+      const bool atEnd   = i + 2 == text.size();
+      const bool beforeSeparator =
+          !atEnd && (text[i + 2] == '/' || text[i + 2] == '\\');
+      if (!atStart || (!atEnd && !beforeSeparator)) {
+        error = BIT7Z_STRING("'**' must be a whole path component");
+        return nullopt;
+      }
+
+      if (atEnd) {
+        tokens.push_back({Token::GLOBSTAR, {}, 0});
+        i += 1;
+      } else {
+        tokens.push_back({Token::GLOBSTAR_DIRECTORY, {}, 0});
+        i += 2;
+      }
+    } else {
+      tokens.push_back({Token::STAR, {}, 0});
+    }
+  }
+
+  return tokens;
+}
+
+/// a pattern and what to do with the paths it matches
+struct CompiledRule
+{
+  PathRule::Action action;
+  vector<Token> pattern;
+  vector<Token> replacement;
+  uint32_t captureCount = 0;
+};
+
+/**
+ * Match a path against the tokens of a pattern, recording the captured ranges.
+ *
+ * Wildcards first try to match as much as possible and backtrack. Positions known to
+ * fail are remembered, so a match takes at most tokens * length^2 steps whatever the
+ * pattern. The captures and the failed positions are stored in the given buffers,
+ * which keep their memory for the next match.
+ */
+class Matcher
+{
+public:
+  Matcher(vector<Token> const& tokens, native_string_view path,
+          native_string_view comparedPath, vector<pair<size_t, size_t>>& captures,
+          vector<bool>& failed)
+      : m_Tokens(tokens), m_Path(path), m_Compared(comparedPath), m_Captures(captures),
+        m_Failed(failed)
+  {
+    m_Failed.assign((tokens.size() + 1) * (path.size() + 1), false);
+  }
+
+  bool match() { return match(0, 0); }
+
+private:
+  bool match(size_t token, size_t position)
+  {
+    if (token == m_Tokens.size()) {
+      return position == m_Path.size();
+    }
+
+    const size_t state = token * (m_Path.size() + 1) + position;
+    if (m_Failed[state]) {
+      return false;
+    }
+
+    const Token& current = m_Tokens[token];
+    switch (current.type) {
+    case Token::LITERAL:
+      if (m_Compared.substr(position, current.text.size()) == current.text &&
+          match(token + 1, position + current.text.size())) {
+        return true;
+      }
+      break;
+
+    case Token::QUESTION:
+      if (position < m_Path.size() && m_Path[position] != '/' &&
+          capture(token, position, position + 1, position + 1)) {
+        return true;
+      }
+      break;
+
+    case Token::STAR: {
+      const size_t end = min(m_Path.find('/', position), m_Path.size());
+      for (size_t next = end + 1; next-- > position;) {
+        if (capture(token, position, next, next)) {
+          return true;
+        }
+      }
+      break;
+    }
+
+    case Token::GLOBSTAR:
+      for (size_t next = m_Path.size() + 1; next-- > position;) {
+        if (capture(token, position, next, next)) {
+          return true;
+        }
+      }
+      break;
+
+    case Token::GLOBSTAR_DIRECTORY:
+      // whole directories, separator excluded from the capture, or nothing
+      for (size_t separator = m_Path.size(); separator-- > position;) {
+        if (m_Path[separator] == '/' &&
+            capture(token, position, separator, separator + 1)) {
+          return true;
+        }
+      }
+      if (capture(token, position, position, position)) {
+        return true;
+      }
+      break;
+    }
+
+    m_Failed[state] = true;
+    return false;
+  }
+
+  // capture [begin, end) for the given wildcard and match the rest from next
+  bool capture(size_t token, size_t begin, size_t end, size_t next)
+  {
+    m_Captures[m_Tokens[token].capture] = {begin, end - begin};
+    return match(token + 1, next);
+  }
+
+  vector<Token> const& m_Tokens;
+  native_string_view m_Path;
+  native_string_view m_Compared;
+  vector<pair<size_t, size_t>>& m_Captures;
+  vector<bool>& m_Failed;
+};
+
+/**
+ * Rules compiled for matching: the literal prefixes of the patterns are stored in a
+ * trie, so that only the rules whose prefix starts the path are matched against it.
+ */
+class PathRulesImpl : public PathRules
+{
+public:
+  PathRulesImpl(vector<CompiledRule> rules, bool caseSensitive)
+      : m_Rules(std::move(rules)), m_CaseSensitive(caseSensitive)
+  {
+    m_Nodes.emplace_back();
+    for (uint32_t i = 0; i < m_Rules.size(); ++i) {
+      const auto& pattern = m_Rules[i].pattern;
+      const native_string_view prefix =
+          !pattern.empty() && pattern.front().type == Token::LITERAL
+              ? native_string_view(pattern.front().text)
+              : native_string_view();
+
+      uint32_t node = 0;
+      for (const char_type c : prefix) {
+        node = addChild(node, c);
+      }
+      m_Nodes[node].rules.push_back(i);
+    }
+  }
+
+  using PathRules::apply;
+
+  Result apply(native_string_view path, native_string& output,
+               Buffers& buffers) const override
+  {
+    const native_string normalized = PathIndex::normalize(path);
+    const native_string folded =
+        m_CaseSensitive ? native_string() : foldCase(normalized);
+    const native_string_view compared = m_CaseSensitive ? normalized : folded;
+
+    // rules whose literal prefix starts the path
+    auto& candidates = buffers.candidates;
+    candidates.assign(m_Nodes[0].rules.begin(), m_Nodes[0].rules.end());
+    uint32_t node = 0;
+    for (const char_type c : compared) {
+      node = child(node, c);
+      if (node == NO_NODE) {
+        break;
+      }
+      candidates.insert(candidates.end(), m_Nodes[node].rules.begin(),
+                        m_Nodes[node].rules.end());
+    }
+    ranges::sort(candidates);
+
+    auto& captures = buffers.captures;
+    for (const uint32_t index : candidates) {
+      const CompiledRule& rule = m_Rules[index];
+      captures.assign(rule.captureCount, {0, 0});
+      if (!Matcher(rule.pattern, normalized, compared, captures, buffers.failed)
+               .match()) {
+        continue;
+      }
+
+      if (rule.action == PathRule::Action::SKIP) {
+        return Result::SKIPPED;
+      }
+
+      output.clear();
+      for (const Token& token : rule.replacement) {
+        if (token.type == Token::LITERAL) {
+          output += token.text;
+          continue;
+        }
+
+        const auto [begin, size] = captures[token.capture];
+        output.append(normalized, begin, size);
+        if (token.type == Token::GLOBSTAR_DIRECTORY && size > 0) {
+          output += '/';
+        }
+      }
+      output = PathIndex::normalize(output);
+      return Result::MAPPED;
+    }
+
+    return Result::NO_MATCH;
+  }
+
+private:
+  static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+  struct Node
+  {
+    vector<pair<char_type, uint32_t>> children;
+
+    // rules whose literal prefix ends at this node
+    vector<uint32_t> rules;
+  };
+
+  uint32_t child(uint32_t node, char_type c) const
+  {
+    for (const auto& [key, next] : m_Nodes[node].children) {
+      if (key == c) {
+        return next;
+      }
+    }
+    return NO_NODE;
+  }
+
+  uint32_t addChild(uint32_t node, char_type c)
+  {
+    const uint32_t existing = child(node, c);
+    if (existing != NO_NODE) {
+      return existing;
+    }
+
+    m_Nodes.emplace_back();
+    const auto next = static_cast<uint32_t>(m_Nodes.size() - 1);
+    m_Nodes[node].children.emplace_back(c, next);
+    return next;
+  }
+
+  vector<CompiledRule> m_Rules;
+  vector<Node> m_Nodes;
+  bool m_CaseSensitive;
+};
+
+/**
+ * Compile a single rule.
+ *
+ * @return the compiled rule, or nothing if it is invalid, in which case error is set.
+ */
+optional<CompiledRule> compileRule(PathRule const& rule, bool caseSensitive,
+                                   tstring& error)
+{
+  const native_string pattern = PathIndex::normalize(rule.pattern);
+  if (pattern.empty()) {
+    error = BIT7Z_STRING("empty pattern");
+    return nullopt;
+  }
+
+  auto patternTokens = tokenize(pattern, error);
+  if (!patternTokens) {
+    return nullopt;
+  }
+
+  CompiledRule compiled{rule.action, std::move(*patternTokens), {}, 0};
+
+  // number the captures of the pattern by kind, the replacement uses them in order
+  vector<uint32_t> capturesByKind[CAPTURE_KIND_COUNT];
+  for (Token& token : compiled.pattern) {
+    if (token.type == Token::LITERAL) {
+      if (!caseSensitive) {
+        token.text = foldCase(token.text);
+      }
+      continue;
+    }
+    token.capture = compiled.captureCount++;
+    capturesByKind[captureKind(token.type)].push_back(token.capture);
+  }
+
+  if (rule.action == PathRule::Action::SKIP) {
+    return compiled;
+  }
+
+  auto replacementTokens = tokenize(rule.replacement, error);
+  if (!replacementTokens) {
+    return nullopt;
+  }
+
+  size_t used[CAPTURE_KIND_COUNT]{};
+  for (Token& token : *replacementTokens) {
+    if (token.type == Token::LITERAL) {
+      continue;
+    }
+
+    const CaptureKind kind = captureKind(token.type);
+    if (used[kind] == capturesByKind[kind].size()) {
+      error = BIT7Z_STRING("the replacement has more wildcards than the pattern");
+      return nullopt;
+    }
+    token.capture = capturesByKind[kind][used[kind]++];
+  }
+  compiled.replacement = std::move(*replacementTokens);
+
+  return compiled;
+}
+
+}  // namespace
+
+DLLEXPORT std::shared_ptr<const PathRules>
+CompilePathRules(std::span<const PathRule> rules, Archive::PathMatch match,
+                 native_string& error)
+{
+  const bool caseSensitive = match == Archive::PathMatch::EXACT;
+
+  vector<CompiledRule> compiled;
+  compiled.reserve(rules.size());
+  for (size_t i = 0; i < rules.size(); ++i) {
+    tstring ruleError;
+    auto rule = compileRule(rules[i], caseSensitive, ruleError);
+    if (!rule) {
+      error = to_native_string(format(BIT7Z_STRING("Rule {} ('{}'): {}"), i,
+                                      to_tstring(rules[i].pattern), ruleError));
+      return nullptr;
+    }
+    compiled.push_back(std::move(*rule));
+  }
+
+  return make_shared<PathRulesImpl>(std::move(compiled), caseSensitive);
+}
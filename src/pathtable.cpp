@@ -0,0 +1,16 @@
+#include "pathtable.h"
+
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+void PathTable::push_back(native_string_view path)
+{
+  if (m_Blob.size() + path.size() > numeric_limits<uint32_t>::max()) {
+    throw length_error("the paths of the archive are too long");
+  }
+
+  m_Blob.append(path);
+  m_Offsets.push_back(static_cast<uint32_t>(m_Blob.size()));
+}
@@ -0,0 +1,55 @@
+#ifndef PATHTABLE_H
+#define PATHTABLE_H
+
+#include "archive.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Paths of the entries of an archive, stored back to back in a single string so that
+ * entries only cost an offset each.
+ *
+ * Views returned by operator[] remain valid until the next push_back() or clear().
+ */
+class PathTable
+{
+public:
+  void reserve(std::size_t count) { m_Offsets.reserve(count + 1); }
+
+  void clear()
+  {
+    m_Blob.clear();
+    m_Offsets.assign(1, 0);
+  }
+
+  /**
+   * @brief Append the path of the next entry.
+   */
+  void push_back(native_string_view path);
+
+  /**
+   * @brief Release the memory reserved for paths that were never added.
+   */
+  void shrink_to_fit()
+  {
+    m_Blob.shrink_to_fit();
+    m_Offsets.shrink_to_fit();
+  }
+
+  [[nodiscard]] native_string_view operator[](std::size_t index) const
+  {
+    return native_string_view(m_Blob).substr(m_Offsets[index],
+                                             m_Offsets[index + 1] - m_Offsets[index]);
+  }
+
+  [[nodiscard]] std::size_t size() const { return m_Offsets.size() - 1; }
+
+private:
+  native_string m_Blob;
+
+  // offset of each path in the blob, followed by the size of the blob
+  std::vector<uint32_t> m_Offsets{0};
+};
+
+#endif  // PATHTABLE_H
@@ -0,0 +1,156 @@
+#include "prefetch.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+// smallest buffer worth a task of its own
+constexpr size_t MIN_BUFFER_SIZE = 64 * 1024;
+}  // namespace
+
+PrefetchStreamBuf::PrefetchStreamBuf(std::shared_ptr<FileInputStream> file,
+                                     std::shared_ptr<Executor> executor,
+                                     std::size_t windowSize,
+                                     std::shared_ptr<PrefetchCounters> counters)
+    : m_File(std::move(file)), m_Executor(std::move(executor)),
+      m_Counters(std::move(counters)),
+      m_Buffer(max(windowSize / 2, MIN_BUFFER_SIZE)), m_Next(make_shared<Slot>())
+{
+  m_Next->data.resize(m_Buffer.size());
+  reset(0);
+}
+
+void PrefetchStreamBuf::reset(uint64_t position)
+{
+  m_BufferOffset = position;
+  setg(m_Buffer.data(), m_Buffer.data(), m_Buffer.data());
+}
+
+bool PrefetchStreamBuf::fill(Slot& slot, FileInputStream& file)
+{
+  {
+    lock_guard lock(slot.mutex);
+    if (slot.state != Slot::State::QUEUED) {
+      return false;
+    }
+    slot.state = Slot::State::READING;
+  }
+
+  const size_t size = file.read(slot.offset, as_writable_bytes(span(slot.data)));
+  {
+    lock_guard lock(slot.mutex);
+    slot.size  = size;
+    slot.state = Slot::State::READY;
+  }
+  slot.done.notify_all();
+  return true;
+}
+
+bool PrefetchStreamBuf::wait()
+{
+  if (fill(*m_Next, *m_File)) {
+    return false;
+  }
+
+  unique_lock lock(m_Next->mutex);
+  m_Next->done.wait(lock, [this] {
+    return m_Next->state == Slot::State::READY;
+  });
+  return true;
+}
+
+void PrefetchStreamBuf::prefetch(uint64_t offset)
+{
+  if (offset >= m_File->size()) {
+    m_Next->size = 0;
+    return;
+  }
+
+  {
+    lock_guard lock(m_Next->mutex);
+    m_Next->offset = offset;
+    m_Next->size   = 0;
+    m_Next->state  = Slot::State::QUEUED;
+  }
+
+  // let the system fetch the range after this one while the task reads this one
+  m_File->willNeed(offset + m_Buffer.size(), m_Buffer.size());
+
+  m_Executor->submit([slot = m_Next, file = m_File] {
+    fill(*slot, *file);
+  });
+}
+
+PrefetchStreamBuf::int_type PrefetchStreamBuf::underflow()
+{
+  if (gptr() < egptr()) {
+    return traits_type::to_int_type(*gptr());
+  }
+
+  const uint64_t current = position();
+  if (current >= m_File->size()) {
+    return traits_type::eof();
+  }
+
+  const bool readAhead = wait();
+
+  if (current >= m_Next->offset && current < m_Next->offset + m_Next->size) {
+    (readAhead ? m_Counters->hits : m_Counters->misses)
+        .fetch_add(1, memory_order_relaxed);
+    m_Buffer.swap(m_Next->data);
+    m_BufferOffset = m_Next->offset;
+    setg(m_Buffer.data(), m_Buffer.data() + (current - m_BufferOffset),
+         m_Buffer.data() + m_Next->size);
+  } else {
+    m_Counters->misses.fetch_add(1, memory_order_relaxed);
+    reset(current);
+    const size_t size = m_File->read(current, as_writable_bytes(span(m_Buffer)));
+    if (size == 0) {
+      return traits_type::eof();
+    }
+    setg(m_Buffer.data(), m_Buffer.data(), m_Buffer.data() + size);
+  }
+
+  prefetch(m_BufferOffset + static_cast<uint64_t>(egptr() - eback()));
+  return traits_type::to_int_type(*gptr());
+}
+
+PrefetchStreamBuf::pos_type PrefetchStreamBuf::seekoff(off_type offset,
+                                                       std::ios_base::seekdir direction,
+                                                       std::ios_base::openmode mode)
+{
+  if (!(mode & ios_base::in)) {
+    return pos_type(off_type(-1));
+  }
+
+  int64_t base = 0;
+  if (direction == ios_base::cur) {
+    base = static_cast<int64_t>(position());
+  } else if (direction == ios_base::end) {
+    base = static_cast<int64_t>(m_File->size());
+  }
+  const int64_t target = base + offset;
+  if (target < 0) {
+    return pos_type(off_type(-1));
+  }
+
+  // keep the buffered data if the target is inside of it, otherwise the next refill
+  // checks the prefetched range
+  const auto newPosition = static_cast<uint64_t>(target);
+  if (newPosition >= m_BufferOffset &&
+      newPosition <= m_BufferOffset + static_cast<uint64_t>(egptr() - eback())) {
+    setg(eback(), eback() + (newPosition - m_BufferOffset), egptr());
+  } else {
+    reset(newPosition);
+  }
+
+  return pos_type(target);
+}
+
+PrefetchStreamBuf::pos_type PrefetchStreamBuf::seekpos(pos_type position,
+                                                       std::ios_base::openmode mode)
+{
+  return seekoff(off_type(position), ios_base::beg, mode);
+}
@@ -0,0 +1,100 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "archive.h"
+#include "inputstreams.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <streambuf>
+#include <vector>
+
+/// counters of a PrefetchStreamBuf, shared with the archive that reports them
+struct PrefetchCounters
+{
+  // buffer refills served by data read ahead
+  std::atomic<uint64_t> hits = 0;
+
+  // buffer refills that had to wait for a read of their own
+  std::atomic<uint64_t> misses = 0;
+};
+
+/**
+ * std::streambuf over a file that reads the range following the current buffer in
+ * the background, so that 7z does not wait for the disk on every refill.
+ *
+ * The window is split in two buffers: 7z reads from the current one while the next
+ * one is filled by a task on the executor, and they are swapped on refill.
+ */
+class PrefetchStreamBuf : public std::streambuf
+{
+public:
+  PrefetchStreamBuf(std::shared_ptr<FileInputStream> file,
+                    std::shared_ptr<Executor> executor, std::size_t windowSize,
+                    std::shared_ptr<PrefetchCounters> counters);
+
+protected:
+  int_type underflow() override;
+  pos_type seekoff(off_type offset, std::ios_base::seekdir direction,
+                   std::ios_base::openmode mode) override;
+  pos_type seekpos(pos_type position, std::ios_base::openmode mode) override;
+
+private:
+  // buffer filled in the background, shared with the task filling it so that the
+  // stream can be destroyed while a read is in flight
+  struct Slot
+  {
+    enum class State
+    {
+      READY,
+
+      // the task has been submitted but has not started, whoever claims the slot
+      // first reads it
+      QUEUED,
+
+      READING
+    };
+
+    std::mutex mutex;
+    std::condition_variable done;
+    std::vector<char_type> data;
+    uint64_t offset  = 0;
+    std::size_t size = 0;
+    State state      = State::READY;
+  };
+
+  // read the range of the slot if it has not been claimed yet, false if it has
+  static bool fill(Slot& slot, FileInputStream& file);
+
+  // position of the next character to read in the file
+  [[nodiscard]] uint64_t position() const
+  {
+    return m_BufferOffset + static_cast<uint64_t>(gptr() - eback());
+  }
+
+  // drop the buffered data and move to the given position
+  void reset(uint64_t position);
+
+  // start reading the range at the given offset in the next slot
+  void prefetch(uint64_t offset);
+
+  // wait for the read of the next slot to complete, reading it from this thread if
+  // its task has not started: the executor may be busy, or running this very thread
+  //
+  // @return true if the slot was read ahead
+  bool wait();
+
+  std::shared_ptr<FileInputStream> m_File;
+  std::shared_ptr<Executor> m_Executor;
+  std::shared_ptr<PrefetchCounters> m_Counters;
+
+  std::vector<char_type> m_Buffer;
+
+  // position of the first character of the buffer in the file
+  uint64_t m_BufferOffset = 0;
+
+  std::shared_ptr<Slot> m_Next;
+};
+
+#endif  // PREFETCH_H
@@ -0,0 +1,109 @@
+#include "priority.h"
+
+#include <cerrno>
+#include <exception>
+#include <thread>
+
+#ifdef __unix__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace
+{
+
+#ifdef __linux__
+// from linux/ioprio.h, which is not available everywhere
+constexpr int IOPRIO_CLASS_SHIFT = 13;
+constexpr int IOPRIO_CLASS_IDLE  = 3;
+constexpr int IOPRIO_WHO_PROCESS = 1;
+
+// niceness added to the CPU priority of background threads
+constexpr int BACKGROUND_NICENESS = 10;
+
+// with IOPRIO_WHO_PROCESS, 0 targets the calling thread
+int getIoPriority()
+{
+  return static_cast<int>(syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0));
+}
+
+void setIoPriority(int priority)
+{
+  syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, priority);
+}
+#endif
+
+void lowerCurrentThreadPriority()
+{
+#ifdef __unix__
+#ifdef __linux__
+  setIoPriority(IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+
+  // on Linux, setpriority() with a thread id only affects that thread
+  const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+  errno          = 0;
+  const int nice = getpriority(PRIO_PROCESS, tid);
+  if (errno == 0) {
+    setpriority(PRIO_PROCESS, tid, nice + BACKGROUND_NICENESS);
+  }
+#endif
+#else
+  SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#endif
+}
+
+}  // namespace
+
+void runWithBackgroundPriority(std::function<void()> const& function)
+{
+  std::exception_ptr exception;
+  std::thread thread([&] {
+    lowerCurrentThreadPriority();
+    try {
+      function();
+    } catch (...) {
+      exception = std::current_exception();
+    }
+  });
+  thread.join();
+
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+ScopedBackgroundIo::ScopedBackgroundIo(bool enabled) : m_Enabled(enabled)
+{
+  if (!m_Enabled) {
+    return;
+  }
+#ifdef __unix__
+#ifdef __linux__
+  m_PreviousPriority = getIoPriority();
+  setIoPriority(IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+#else
+  SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#endif
+}
+
+ScopedBackgroundIo::~ScopedBackgroundIo()
+{
+  if (!m_Enabled) {
+    return;
+  }
+#ifdef __unix__
+#ifdef __linux__
+  if (m_PreviousPriority >= 0) {
+    setIoPriority(m_PreviousPriority);
+  }
+#endif
+#else
+  SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+#endif
+}
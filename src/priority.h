@@ -0,0 +1,35 @@
+#ifndef PRIORITY_H
+#define PRIORITY_H
+
+#include <functional>
+
+/**
+ * @brief Run the given function on a new thread with idle I/O priority and a lower CPU
+ *   priority, and wait for it.
+ *
+ * A dedicated thread is used rather than one of the executor of the archive because
+ * unprivileged processes cannot raise the CPU priority of a thread back on Linux, so a
+ * worker of the host would stay slowed down, and because waiting for a task of a busy
+ * executor could block the extraction. Exceptions thrown by the function are rethrown
+ * in the calling thread.
+ */
+void runWithBackgroundPriority(std::function<void()> const& function);
+
+/**
+ * Puts the current thread in the idle I/O priority class until destroyed.
+ */
+class ScopedBackgroundIo
+{
+public:
+  explicit ScopedBackgroundIo(bool enabled);
+  ~ScopedBackgroundIo();
+
+  ScopedBackgroundIo(const ScopedBackgroundIo&)            = delete;
+  ScopedBackgroundIo& operator=(const ScopedBackgroundIo&) = delete;
+
+private:
+  bool m_Enabled;
+  int m_PreviousPriority = 0;
+};
+
+#endif  // PRIORITY_H
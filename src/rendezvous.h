@@ -0,0 +1,109 @@
+#ifndef RENDEZVOUS_H
+#define RENDEZVOUS_H
+
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+
+/**
+ * Hands values from a producer thread to a consumer thread one at a time.
+ *
+ * put() only returns once the consumer is done with the value, so values can refer to
+ * data owned by the producer without copying it. The consumer is done with a value
+ * when it takes the next one or closes the rendezvous.
+ */
+template <typename T>
+class Rendezvous
+{
+public:
+  /**
+   * @brief Give a value to the consumer and wait until it is done with it.
+   *
+   * @return false if the consumer closed the rendezvous, true otherwise.
+   */
+  bool put(T value)
+  {
+    std::unique_lock lock(m_Mutex);
+    if (m_Closed) {
+      return false;
+    }
+
+    m_Value = std::move(value);
+    m_State = State::READY;
+    m_Changed.notify_all();
+
+    m_Changed.wait(lock, [this] {
+      return m_Closed || m_State == State::EMPTY;
+    });
+    return !m_Closed;
+  }
+
+  /**
+   * @brief Signal the consumer that there are no more values.
+   */
+  void finish()
+  {
+    {
+      std::scoped_lock lock(m_Mutex);
+      m_Finished = true;
+    }
+    m_Changed.notify_all();
+  }
+
+  /**
+   * @brief Release the previous value and wait for the next one.
+   *
+   * @return the next value, or nothing once the producer has finished.
+   */
+  std::optional<T> take()
+  {
+    std::unique_lock lock(m_Mutex);
+    if (m_State == State::TAKEN) {
+      m_State = State::EMPTY;
+      m_Value.reset();
+      m_Changed.notify_all();
+    }
+
+    m_Changed.wait(lock, [this] {
+      return m_Finished || m_State == State::READY;
+    });
+    if (m_State != State::READY) {
+      return std::nullopt;
+    }
+
+    m_State = State::TAKEN;
+    return m_Value;
+  }
+
+  /**
+   * @brief Release the current value and make the pending and future put() fail.
+   */
+  void close()
+  {
+    {
+      std::scoped_lock lock(m_Mutex);
+      m_Closed = true;
+      m_State  = State::EMPTY;
+      m_Value.reset();
+    }
+    m_Changed.notify_all();
+  }
+
+private:
+  enum class State
+  {
+    EMPTY,
+    READY,
+    TAKEN
+  };
+
+  std::mutex m_Mutex;
+  std::condition_variable m_Changed;
+
+  std::optional<T> m_Value;
+  State m_State   = State::EMPTY;
+  bool m_Finished = false;
+  bool m_Closed   = false;
+};
+
+#endif  // RENDEZVOUS_H
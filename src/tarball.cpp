@@ -0,0 +1,572 @@
+#include "tarball.h"
+
+#include <bit7z/bitexception.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <format>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace bit7z;
+using namespace std;
+
+namespace
+{
+
+constexpr size_t BLOCK_SIZE = 512;
+
+// attributes reported by 7z for the entries of tar archives
+constexpr uint32_t FILE_ATTRIBUTE_DIRECTORY      = 0x10;
+constexpr uint32_t FILE_ATTRIBUTE_UNIX_EXTENSION = 0x8000;
+
+uint64_t padToBlock(uint64_t size)
+{
+  return (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+}
+
+// a NUL-terminated field of a header
+string_view field(string_view block, size_t offset, size_t size)
+{
+  const auto value = block.substr(offset, size);
+  return value.substr(0, value.find('\0'));
+}
+
+// a numeric field of a header, in octal or in base-256 for large values (GNU)
+uint64_t number(string_view block, size_t offset, size_t size)
+{
+  const auto value = block.substr(offset, size);
+
+  uint64_t result = 0;
+  if (static_cast<unsigned char>(value[0]) & 0x80) {
+    result = static_cast<unsigned char>(value[0]) & 0x7F;
+    for (size_t i = 1; i < value.size(); ++i) {
+      result = (result << 8) | static_cast<unsigned char>(value[i]);
+    }
+    return result;
+  }
+
+  size_t i = 0;
+  while (i < value.size() && value[i] == ' ') {
+    ++i;
+  }
+  for (; i < value.size() && value[i] >= '0' && value[i] <= '7'; ++i) {
+    result = result * 8 + static_cast<uint64_t>(value[i] - '0');
+  }
+  return result;
+}
+
+// check the checksum of a header, computed with its own field filled with spaces;
+// some old implementations summed signed bytes
+bool hasValidChecksum(string_view block)
+{
+  const uint64_t expected = number(block, 148, 8);
+
+  uint64_t unsignedSum = 0;
+  int64_t signedSum    = 0;
+  for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+    const char c = i >= 148 && i < 156 ? ' ' : block[i];
+    unsignedSum += static_cast<unsigned char>(c);
+    signedSum += static_cast<signed char>(c);
+  }
+
+  return expected == unsignedSum || static_cast<int64_t>(expected) == signedSum;
+}
+
+// the decimal number at the start of the value, ignoring any fraction
+uint64_t decimal(string_view value)
+{
+  uint64_t result = 0;
+  for (size_t i = 0; i < value.size() && value[i] >= '0' && value[i] <= '9'; ++i) {
+    result = result * 10 + static_cast<uint64_t>(value[i] - '0');
+  }
+  return result;
+}
+
+/// incremental parser of the headers of a tar stream
+class TarParser
+{
+public:
+  struct Header
+  {
+    char type;
+    string path;
+
+    // target of hard and symbolic links
+    string linkPath;
+
+    uint64_t dataOffset;
+    uint64_t size;
+    int64_t modified;
+    uint32_t mode;
+    bool directory;
+  };
+
+  using HeaderCallback = function<void(Header&&)>;
+
+  explicit TarParser(HeaderCallback onHeader) : m_OnHeader(std::move(onHeader)) {}
+
+  /**
+   * @brief Parse the next bytes of the stream.
+   *
+   * @return false if the stream is not a valid tar stream.
+   */
+  bool feed(const char* data, size_t size)
+  {
+    while (size > 0 && !m_Ended) {
+      if (m_Skip > 0) {
+        const auto count = static_cast<size_t>(min<uint64_t>(m_Skip, size));
+        const auto kept  = static_cast<size_t>(min<uint64_t>(m_Collect, count));
+        m_Extra.append(data, kept);
+        m_Collect -= kept;
+        m_Skip -= count;
+        advance(data, size, count);
+
+        if (m_Skip == 0 && m_Collecting) {
+          finishExtra();
+        }
+        continue;
+      }
+
+      const size_t count = min(BLOCK_SIZE - m_BlockSize, size);
+      memcpy(m_Block.data() + m_BlockSize, data, count);
+      m_BlockSize += count;
+      advance(data, size, count);
+
+      if (m_BlockSize == BLOCK_SIZE) {
+        m_BlockSize = 0;
+        if (!parseHeader(string_view(m_Block.data(), BLOCK_SIZE))) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // true once the end-of-archive block has been read
+  [[nodiscard]] bool ended() const { return m_Ended; }
+
+  // true if the stream read so far is a whole tar archive, some writers omit the
+  // end-of-archive blocks
+  [[nodiscard]] bool complete() const
+  {
+    return m_Ended ||
+           (m_Valid && m_Skip == 0 && m_BlockSize == 0 && !m_Collecting &&
+            !m_ExtendedPending);
+  }
+
+private:
+  void advance(const char*& data, size_t& size, size_t count)
+  {
+    data += count;
+    size -= count;
+    m_Position += count;
+  }
+
+  bool parseHeader(string_view block)
+  {
+    if (ranges::all_of(block, [](char c) {
+          return c == '\0';
+        })) {
+      // an empty archive is not worth listing, nor told apart from garbage
+      m_Ended = m_Valid;
+      return m_Valid;
+    }
+
+    if (!hasValidChecksum(block)) {
+      return false;
+    }
+    m_Valid = true;
+
+    const char type     = block[156];
+    const uint64_t size = number(block, 124, 12);
+
+    switch (type) {
+    case 'L':  // GNU long name of the next entry
+    case 'K':  // GNU long link name of the next entry
+    case 'x':  // pax extended header of the next entry
+      m_Collecting      = true;
+      m_ExtendedPending = true;
+      m_ExtraType       = type;
+      m_Extra.clear();
+      m_Collect = size;
+      m_Skip    = padToBlock(size);
+      if (m_Skip == 0) {
+        finishExtra();
+      }
+      return true;
+
+    case 'g':  // pax global header
+      m_Skip = padToBlock(size);
+      return true;
+
+    default:
+      break;
+    }
+
+    // links, devices and fifos have no data, whatever their size says
+    const bool hasData = type != '1' && type != '2' && type != '3' && type != '4' &&
+                         type != '5' && type != '6';
+
+    Header header;
+    header.type = type;
+    if (m_LongName) {
+      header.path = std::move(*m_LongName);
+    } else {
+      const auto name   = field(block, 0, 100);
+      const auto prefix = field(block, 345, 155);
+      if (block.substr(257, 5) == "ustar" && !prefix.empty()) {
+        header.path.append(prefix).append("/");
+      }
+      header.path.append(name);
+    }
+    header.linkPath =
+        m_LongLink ? std::move(*m_LongLink) : string(field(block, 157, 100));
+
+    header.directory  = type == '5' || header.path.ends_with('/');
+    header.dataOffset = m_Position;
+    header.size       = hasData ? m_PaxSize.value_or(size) : 0;
+    header.modified =
+        static_cast<int64_t>(m_PaxModified.value_or(number(block, 136, 12)));
+    header.mode = static_cast<uint32_t>(number(block, 100, 8));
+
+    while (header.path.size() > 1 && header.path.ends_with('/')) {
+      header.path.pop_back();
+    }
+
+    m_Skip = padToBlock(header.size);
+    m_LongName.reset();
+    m_LongLink.reset();
+    m_PaxSize.reset();
+    m_PaxModified.reset();
+    m_ExtendedPending = false;
+
+    m_OnHeader(std::move(header));
+    return true;
+  }
+
+  // apply an extended header to the next entry once it has been read
+  void finishExtra()
+  {
+    m_Collecting = false;
+
+    if (m_ExtraType == 'L') {
+      m_LongName = string(field(m_Extra, 0, m_Extra.size()));
+      return;
+    }
+    if (m_ExtraType == 'K') {
+      m_LongLink = string(field(m_Extra, 0, m_Extra.size()));
+      return;
+    }
+
+    // records are "<length> <key>=<value>\n", the length including the whole record
+    string_view records(m_Extra);
+    while (!records.empty()) {
+      const size_t space  = records.find(' ');
+      const size_t length = static_cast<size_t>(decimal(records));
+      if (space == string_view::npos || length <= space + 1 ||
+          length > records.size()) {
+        break;
+      }
+
+      auto record = records.substr(space + 1, length - space - 1);
+      if (record.ends_with('\n')) {
+        record.remove_suffix(1);
+      }
+      records.remove_prefix(length);
+
+      const size_t equal = record.find('=');
+      if (equal == string_view::npos) {
+        continue;
+      }
+      const auto key   = record.substr(0, equal);
+      const auto value = record.substr(equal + 1);
+
+      if (key == "path") {
+        m_LongName = string(value);
+      } else if (key == "linkpath") {
+        m_LongLink = string(value);
+      } else if (key == "size") {
+        m_PaxSize = decimal(value);
+      } else if (key == "mtime") {
+        m_PaxModified = decimal(value);
+      }
+    }
+  }
+
+  HeaderCallback m_OnHeader;
+
+  array<char, BLOCK_SIZE> m_Block{};
+  size_t m_BlockSize = 0;
+
+  // offset of the next byte in the stream
+  uint64_t m_Position = 0;
+
+  // bytes of data and padding to skip before the next header, the first m_Collect
+  // of which are the content of an extended header
+  uint64_t m_Skip    = 0;
+  uint64_t m_Collect = 0;
+
+  // extended header being read, and its content
+  bool m_Collecting      = false;
+  bool m_ExtendedPending = false;
+  char m_ExtraType       = 0;
+  string m_Extra;
+
+  // values of the extended headers for the next entry
+  optional<string> m_LongName;
+  optional<string> m_LongLink;
+  optional<uint64_t> m_PaxSize;
+  optional<uint64_t> m_PaxModified;
+
+  bool m_Valid = false;
+  bool m_Ended = false;
+};
+
+// path of an entry as listed, from its path in the tar archive
+native_string entryPath(string path)
+{
+#ifndef __unix__
+  ranges::replace(path, '/', '\\');
+#endif
+  return to_native_string(to_tstring(path));
+}
+
+// what an entry without data is, for the log
+const tchar* dataLessKind(char type)
+{
+  switch (type) {
+  case '2':
+    return BIT7Z_STRING("symbolic link");
+  case '3':
+    return BIT7Z_STRING("character device");
+  case '4':
+    return BIT7Z_STRING("block device");
+  default:
+    return BIT7Z_STRING("fifo");
+  }
+}
+
+}  // namespace
+
+std::shared_ptr<TarballReader>
+TarballReader::open(std::shared_ptr<bit7z::BitArchiveReader> compressed,
+                    Archive::LogCallback const& logCallback)
+{
+  if (compressed->itemsCount() != 1) {
+    return nullptr;
+  }
+
+  auto reader = shared_ptr<TarballReader>(new TarballReader(compressed));
+
+  // index of the last entry with each path, only built once a hard link needs it
+  unordered_map<native_string, uint32_t> entriesByPath;
+  bool indexed = false;
+
+  auto skip = [&](tstring const& kind, native_string const& path) {
+    const auto message = format(BIT7Z_STRING("Skipped {} '{}' of the tar archive"),
+                                kind, to_tstring(path));
+    logCallback(Archive::LogLevel::Warning, to_native_string(message));
+  };
+
+  TarParser parser([&](TarParser::Header&& header) {
+    native_string path = entryPath(std::move(header.path));
+    Entry entry{header.dataOffset, header.size, header.modified, header.mode,
+                header.directory};
+
+    switch (header.type) {
+    case '1': {
+      // hard links have the data of the last entry with the path they link to
+      if (!indexed) {
+        for (uint32_t i = 0; i < reader->m_Entries.size(); ++i) {
+          entriesByPath.insert_or_assign(native_string(reader->m_Paths[i]), i);
+        }
+        indexed = true;
+      }
+
+      const auto target = entriesByPath.find(entryPath(std::move(header.linkPath)));
+      if (target == entriesByPath.end() ||
+          reader->m_Entries[target->second].directory) {
+        skip(BIT7Z_STRING("hard link without target"), path);
+        return;
+      }
+      entry.dataOffset = reader->m_Entries[target->second].dataOffset;
+      entry.size       = reader->m_Entries[target->second].size;
+      break;
+    }
+    case '2':
+    case '3':
+    case '4':
+    case '6':
+      // extracting them would only create empty files
+      skip(dataLessKind(header.type), path);
+      return;
+    default:
+      break;
+    }
+
+    if (indexed) {
+      const auto index = static_cast<uint32_t>(reader->m_Entries.size());
+      entriesByPath.insert_or_assign(path, index);
+    }
+    reader->m_Paths.push_back(path);
+    reader->m_Entries.push_back(entry);
+  });
+
+  compressed->setFileCallback({});
+  compressed->setProgressCallback({});
+
+  bool valid = true;
+  try {
+    compressed->extractTo(
+        [&](const byte_t* data, const std::size_t size) -> bool {
+          valid = parser.feed(reinterpret_cast<const char*>(data), size);
+
+          // the padding after the end-of-archive blocks is not needed
+          return valid && !parser.ended();
+        },
+        {0});
+  } catch (const BitException&) {
+    // either the decoding was stopped above, or the stream is corrupted
+    if (!valid || !parser.ended()) {
+      return nullptr;
+    }
+  }
+
+  if (!parser.complete()) {
+    return nullptr;
+  }
+
+  reader->m_Paths.shrink_to_fit();
+  reader->m_Entries.shrink_to_fit();
+  return reader;
+}
+
+void TarballReader::extractTo(std::span<const uint32_t> indices,
+                              FileCallback const& onFile,
+                              DataCallback const& onData) const
+{
+  // a single pass gives the data to the entries in order, which only works if it does
+  // not overlap; it does when hard links are extracted with the entry they link to
+  const bool ordered =
+      ranges::adjacent_find(indices, [&](uint32_t previous, uint32_t index) {
+        const Entry& entry = m_Entries[previous];
+        return entry.dataOffset + entry.size > m_Entries[index].dataOffset;
+      }) == indices.end();
+  if (ordered) {
+    extractPass(indices, onFile, onData);
+    return;
+  }
+
+  vector<uint32_t> sorted(indices.begin(), indices.end());
+  ranges::stable_sort(sorted, {}, [&](uint32_t index) {
+    return m_Entries[index].dataOffset;
+  });
+
+  // each entry goes to the first pass it does not overlap
+  vector<vector<uint32_t>> passes;
+  vector<uint64_t> passEnds;
+  for (const uint32_t index : sorted) {
+    const Entry& entry = m_Entries[index];
+    size_t pass        = 0;
+    while (pass < passes.size() && passEnds[pass] > entry.dataOffset) {
+      ++pass;
+    }
+    if (pass == passes.size()) {
+      passes.emplace_back();
+      passEnds.push_back(0);
+    }
+    passes[pass].push_back(index);
+    passEnds[pass] = entry.dataOffset + entry.size;
+  }
+
+  for (const auto& pass : passes) {
+    extractPass(pass, onFile, onData);
+  }
+}
+
+void TarballReader::extractPass(std::span<const uint32_t> indices,
+                                FileCallback const& onFile,
+                                DataCallback const& onData) const
+{
+  if (indices.empty()) {
+    return;
+  }
+
+  // next requested entry that has not been fully decoded, and whether its path was
+  // given to onFile
+  size_t next  = 0;
+  bool started = false;
+
+  // offset of the next decoded byte in the tar archive
+  uint64_t position = 0;
+  bool aborted      = false;
+
+  auto cut = [&](const byte_t* data, const std::size_t size) -> bool {
+    const uint64_t end = position + size;
+
+    while (next < indices.size()) {
+      const Entry& entry      = m_Entries[indices[next]];
+      const uint64_t entryEnd = entry.dataOffset + entry.size;
+
+      // the entry starts in a later chunk
+      if (entry.dataOffset > end || (entry.dataOffset == end && entry.size > 0)) {
+        break;
+      }
+
+      if (!started) {
+        onFile(to_tstring(native_string(path(indices[next]))));
+        started = true;
+      }
+
+      const uint64_t first = max(entry.dataOffset, position);
+      const uint64_t last  = min(entryEnd, end);
+      if (last > first && !onData(data + (first - position), last - first)) {
+        aborted = true;
+        return false;
+      }
+
+      // the entry continues in the next chunk
+      if (entryEnd > end) {
+        break;
+      }
+      ++next;
+      started = false;
+    }
+
+    position = end;
+
+    // nothing after the last entry is needed
+    return next < indices.size();
+  };
+
+  m_Compressed->setFileCallback({});
+  try {
+    m_Compressed->extractTo(cut, {0});
+  } catch (const BitException&) {
+    if (aborted || next < indices.size()) {
+      throw;
+    }
+  }
+
+  if (next < indices.size()) {
+    throw BitException("Unexpected end of the tar archive",
+                       make_error_code(errc::io_error));
+  }
+}
+
+std::chrono::system_clock::time_point TarballReader::modified(uint32_t index) const
+{
+  return chrono::system_clock::time_point(chrono::seconds(m_Entries[index].modified));
+}
+
+uint32_t TarballReader::attributes(uint32_t index) const
+{
+  const Entry& entry = m_Entries[index];
+  return FILE_ATTRIBUTE_UNIX_EXTENSION | (entry.mode << 16) |
+         (entry.directory ? FILE_ATTRIBUTE_DIRECTORY : 0);
+}
@@ -0,0 +1,115 @@
+#ifndef TARBALL_H
+#define TARBALL_H
+
+#include "archive.h"
+#include "entrylisting.h"
+#include "pathtable.h"
+
+#include <bit7z/bitarchivereader.hpp>
+
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+/**
+ * Tar archive compressed in a single stream (tar.gz, tar.bz2, tar.xz, tar.zst, ...),
+ * read through the 7z reader of the compressed stream.
+ *
+ * The entries are listed from the tar headers in a single pass over the decoded
+ * stream, and extracted by decoding the stream again and cutting the data of the
+ * requested entries out of it, so the tar archive itself is never stored.
+ */
+class TarballReader : public EntryListing
+{
+public:
+  using FileCallback = std::function<void(const bit7z::tstring&)>;
+  using DataCallback = std::function<bool(const bit7z::byte_t*, std::size_t)>;
+
+  /**
+   * @brief List the tar archive compressed in the single item of the given reader.
+   *
+   * Hard links are listed with the data of the entry they link to. Symbolic links,
+   * devices and fifos have no data and are not listed, each of them being reported
+   * to the log callback.
+   *
+   * @return the listing, or a null pointer if the item is not a tar archive or could
+   *   not be listed, in which case the reader should be used as is.
+   */
+  static std::shared_ptr<TarballReader>
+  open(std::shared_ptr<bit7z::BitArchiveReader> compressed,
+       Archive::LogCallback const& logCallback);
+
+  /**
+   * @brief Decode the given entries over the compressed stream, like
+   *   BitArchiveReader::extractTo() does. Decoding stops after the last entry.
+   *
+   * The entries are decoded in a single pass, unless several of them share their data
+   * (hard links), in which case the stream is decoded again for each of them.
+   *
+   * @param indices Indices of the entries to decode, sorted.
+   * @param onFile Called with the path of each entry before its data.
+   * @param onData Called with the data of the entries, returns false to abort.
+   *
+   * @throws bit7z::BitException if the stream could not be decoded, or was aborted.
+   */
+  void extractTo(std::span<const uint32_t> indices, FileCallback const& onFile,
+                 DataCallback const& onData) const;
+
+  [[nodiscard]] uint32_t count() const override
+  {
+    return static_cast<uint32_t>(m_Entries.size());
+  }
+
+  [[nodiscard]] native_string_view path(uint32_t index) const override
+  {
+    return m_Paths[index];
+  }
+  [[nodiscard]] uint64_t size(uint32_t index) const override
+  {
+    return m_Entries[index].size;
+  }
+  [[nodiscard]] uint32_t crc(uint32_t) const override { return 0; }
+  [[nodiscard]] bool isDirectory(uint32_t index) const override
+  {
+    return m_Entries[index].directory;
+  }
+  [[nodiscard]] uint64_t packedSize(uint32_t) const override { return 0; }
+  [[nodiscard]] std::chrono::system_clock::time_point
+  modified(uint32_t index) const override;
+  [[nodiscard]] uint32_t attributes(uint32_t index) const override;
+  [[nodiscard]] native_string_view method(uint32_t) const override { return {}; }
+  [[nodiscard]] bool isEncrypted(uint32_t) const override { return false; }
+
+  // the whole archive is a single stream, decoded from its start
+  [[nodiscard]] uint32_t block(uint32_t) const override { return 0; }
+
+private:
+  struct Entry
+  {
+    // offset of the data of the entry in the tar archive, hard links having the
+    // offset of the entry they link to
+    uint64_t dataOffset;
+    uint64_t size;
+
+    // seconds since the epoch
+    int64_t modified;
+    uint32_t mode;
+    bool directory;
+  };
+
+  explicit TarballReader(std::shared_ptr<bit7z::BitArchiveReader> compressed)
+      : m_Compressed(std::move(compressed))
+  {}
+
+  // decode the given entries in a single pass, their data being in increasing order
+  // without overlapping
+  void extractPass(std::span<const uint32_t> indices, FileCallback const& onFile,
+                   DataCallback const& onData) const;
+
+  std::shared_ptr<bit7z::BitArchiveReader> m_Compressed;
+  PathTable m_Paths;
+  std::vector<Entry> m_Entries;
+};
+
+#endif  // TARBALL_H
@@ -0,0 +1,83 @@
+#include "threadpool.h"
+
+using namespace std;
+
+namespace
+{
+size_t resolveThreadCount(size_t threadCount)
+{
+  if (threadCount == 0) {
+    threadCount = thread::hardware_concurrency();
+  }
+  return max<size_t>(threadCount, 1);
+}
+}  // namespace
+
+ThreadPool::ThreadPool(std::size_t threadCount)
+{
+  threadCount = resolveThreadCount(threadCount);
+  m_Threads.reserve(threadCount);
+  for (size_t i = 0; i < threadCount; ++i) {
+    m_Threads.emplace_back([this](stop_token stopToken) {
+      run(stopToken);
+    });
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  for (auto& thread : m_Threads) {
+    thread.request_stop();
+  }
+  m_Threads.clear();
+}
+
+void ThreadPool::submit(Task task)
+{
+  {
+    scoped_lock lock(m_Mutex);
+    m_Tasks.push_back(std::move(task));
+  }
+  m_Condition.notify_one();
+}
+
+void ThreadPool::run(std::stop_token stopToken)
+{
+  unique_lock lock(m_Mutex);
+  for (;;) {
+    // only returns false if a stop was requested and there is nothing left to do
+    if (!m_Condition.wait(lock, stopToken, [this] {
+          return !m_Tasks.empty();
+        })) {
+      return;
+    }
+
+    Task task = std::move(m_Tasks.front());
+    m_Tasks.pop_front();
+
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+}
+
+std::shared_ptr<Executor> defaultExecutor()
+{
+  // the pool is not kept alive by a static to avoid joining threads during static
+  // destruction (which deadlocks when the library is unloaded on Windows)
+  static mutex instanceMutex;
+  static weak_ptr<Executor> instance;
+
+  scoped_lock lock(instanceMutex);
+  auto executor = instance.lock();
+  if (!executor) {
+    executor = make_shared<ThreadPool>(0);
+    instance = executor;
+  }
+  return executor;
+}
+
+DLLEXPORT std::shared_ptr<Executor> CreateThreadPoolExecutor(std::size_t threadCount)
+{
+  return std::make_shared<ThreadPool>(threadCount);
+}
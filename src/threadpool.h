@@ -0,0 +1,42 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "archive.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// built-in executor running tasks on a fixed set of worker threads
+class ThreadPool : public Executor
+{
+public:
+  explicit ThreadPool(std::size_t threadCount);
+
+  // remaining tasks are run before the workers are joined
+  ~ThreadPool() override;
+
+  void submit(Task task) override;
+  [[nodiscard]] std::size_t concurrency() const override { return m_Threads.size(); }
+
+private:
+  void run(std::stop_token stopToken);
+
+  std::mutex m_Mutex;
+  std::condition_variable_any m_Condition;
+  std::deque<Task> m_Tasks;
+
+  // must be the last member so the workers are joined before anything else is
+  // destroyed
+  std::vector<std::jthread> m_Threads;
+};
+
+/**
+ * @return the executor shared by all the archives that were not given one, the pool is
+ *   destroyed once no archive uses it anymore.
+ */
+std::shared_ptr<Executor> defaultExecutor();
+
+#endif  // THREADPOOL_H
@@ -0,0 +1,73 @@
+#ifndef TOKENBUCKET_H
+#define TOKENBUCKET_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+/**
+ * Token bucket limiting the number of bytes going through a stage of the extraction.
+ *
+ * The bucket refills at the given rate and holds at most a quarter of a second worth of
+ * tokens. Chunks larger than the bucket are let through by going into debt, which is
+ * then paid back by sleeping, so the average rate is respected whatever the chunk size.
+ */
+class TokenBucket
+{
+  using clock = std::chrono::steady_clock;
+
+public:
+  explicit TokenBucket(uint64_t bytesPerSecond)
+      : m_Rate(static_cast<double>(bytesPerSecond)), m_Capacity(m_Rate / 4),
+        m_Tokens(m_Capacity), m_LastRefill(clock::now())
+  {}
+
+  /**
+   * @brief Take the given number of tokens, sleeping until the bucket is out of debt.
+   *
+   * @param amount Number of tokens (bytes) to take.
+   * @param cancelled Flag checked while sleeping, to stop waiting when the extraction
+   *   is cancelled.
+   */
+  void consume(uint64_t amount, std::atomic<bool> const& cancelled)
+  {
+    double debt;
+    {
+      std::scoped_lock lock(m_Mutex);
+      const auto now       = clock::now();
+      const double elapsed = std::chrono::duration<double>(now - m_LastRefill).count();
+      m_Tokens             = std::min(m_Capacity, m_Tokens + elapsed * m_Rate);
+      m_LastRefill         = now;
+      m_Tokens -= static_cast<double>(amount);
+      debt = -m_Tokens;
+    }
+
+    if (debt <= 0) {
+      return;
+    }
+
+    // sleep in small slices to react to cancellation
+    const auto deadline =
+        clock::now() + std::chrono::duration_cast<clock::duration>(
+                           std::chrono::duration<double>(debt / m_Rate));
+    while (!cancelled.load() && clock::now() < deadline) {
+      std::this_thread::sleep_for(
+          std::min<clock::duration>(deadline - clock::now(), MAX_SLEEP));
+    }
+  }
+
+private:
+  static constexpr std::chrono::milliseconds MAX_SLEEP{50};
+
+  const double m_Rate;
+  const double m_Capacity;
+
+  std::mutex m_Mutex;
+  double m_Tokens;
+  clock::time_point m_LastRefill;
+};
+
+#endif  // TOKENBUCKET_H
@@ -0,0 +1,191 @@
+#include "volumes.h"
+
+#include <algorithm>
+#include <string_view>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+
+using char_type = native_string::value_type;
+
+bool isDigit(char_type c)
+{
+  return c >= '0' && c <= '9';
+}
+
+// check if the name ends with the given lowercase ASCII suffix, ignoring case
+bool endsWith(native_string_view name, string_view suffix)
+{
+  if (name.size() < suffix.size()) {
+    return false;
+  }
+
+  const size_t start = name.size() - suffix.size();
+  for (size_t i = 0; i < suffix.size(); ++i) {
+    auto c = name[start + i];
+    if (c >= 'A' && c <= 'Z') {
+      c = static_cast<char_type>(c - 'A' + 'a');
+    }
+    if (c != static_cast<char_type>(suffix[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// the given number written with at least the given number of digits
+native_string formatNumber(size_t number, size_t width)
+{
+  native_string digits;
+  do {
+    digits.insert(digits.begin(), static_cast<char_type>('0' + number % 10));
+    number /= 10;
+  } while (number > 0);
+
+  if (digits.size() < width) {
+    digits.insert(0, width - digits.size(), '0');
+  }
+  return digits;
+}
+
+// the digits at the end of the name, starting at the returned position
+size_t trailingDigits(native_string_view name)
+{
+  size_t start = name.size();
+  while (start > 0 && isDigit(name[start - 1])) {
+    --start;
+  }
+  return start;
+}
+
+// parse the digits of a volume number, false if they are not 1
+bool isFirst(native_string_view digits)
+{
+  return !digits.empty() && digits.find_first_not_of('0') == digits.size() - 1 &&
+         digits.back() == '1';
+}
+
+// add the volumes following the first one, named by the given function, as long as
+// they exist
+template <typename NameOf>
+void addVolumes(VolumeSet& set, fs::path const& firstVolume, NameOf nameOf)
+{
+  set.paths.push_back(firstVolume);
+
+  error_code ec;
+  for (size_t i = 1;; ++i) {
+    auto path = firstVolume.parent_path() / nameOf(i);
+    if (!fs::is_regular_file(path, ec)) {
+      break;
+    }
+    set.paths.push_back(std::move(path));
+  }
+}
+
+}  // namespace
+
+VolumeSet VolumeSet::find(std::filesystem::path const& firstVolume)
+{
+  const native_string name = firstVolume.filename().native();
+  VolumeSet set;
+
+  // name.ext.001, the number having at least three digits
+  const size_t number = trailingDigits(name);
+  if (name.size() - number >= 3 && number > 0 && name[number - 1] == '.' &&
+      isFirst(native_string_view(name).substr(number))) {
+    const native_string stem = name.substr(0, number);
+    const size_t width       = name.size() - number;
+    addVolumes(set, firstVolume, [&](size_t i) {
+      return stem + formatNumber(i + 1, width);
+    });
+    set.kind = Kind::SPLIT;
+  } else if (endsWith(name, ".rar")) {
+    const native_string_view base = native_string_view(name).substr(0, name.size() - 4);
+    const size_t partNumber       = trailingDigits(base);
+
+    if (partNumber < base.size() && endsWith(base.substr(0, partNumber), ".part") &&
+        isFirst(base.substr(partNumber))) {
+      // name.part1.rar, name.part2.rar, ...
+      const native_string stem(base.substr(0, partNumber));
+      const native_string extension(native_string_view(name).substr(name.size() - 4));
+      const size_t width = base.size() - partNumber;
+      addVolumes(set, firstVolume, [&](size_t i) {
+        return stem + formatNumber(i + 1, width) + extension;
+      });
+      set.kind = Kind::RAR;
+    } else {
+      // name.rar, name.r00, name.r01, ...
+      const native_string stem(native_string_view(name).substr(0, name.size() - 2));
+      addVolumes(set, firstVolume, [&](size_t i) {
+        return stem + formatNumber(i - 1, 2);
+      });
+      set.kind = Kind::RAR;
+    }
+  }
+
+  if (set.paths.size() < 2) {
+    return {};
+  }
+  return set;
+}
+
+std::shared_ptr<VolumeInputStream>
+VolumeInputStream::open(std::vector<std::filesystem::path> const& paths,
+                        std::error_code& ec)
+{
+  vector<Volume> volumes;
+  volumes.reserve(paths.size());
+
+  uint64_t offset = 0;
+  for (const auto& path : paths) {
+    const uint64_t size = fs::file_size(path, ec);
+    if (ec) {
+      return nullptr;
+    }
+    volumes.push_back({path, offset, size, nullptr});
+    offset += size;
+  }
+
+  ec.clear();
+  return shared_ptr<VolumeInputStream>(
+      new VolumeInputStream(std::move(volumes), offset));
+}
+
+std::size_t VolumeInputStream::read(uint64_t offset, std::span<std::byte> buffer)
+{
+  // first volume ending after the offset
+  auto it = ranges::upper_bound(m_Volumes, offset, {}, [](Volume const& volume) {
+    return volume.offset + volume.size;
+  });
+
+  size_t total = 0;
+  for (; it != m_Volumes.end() && total < buffer.size(); ++it) {
+    if (it->size == 0) {
+      continue;
+    }
+
+    if (!it->file) {
+      error_code ec;
+      it->file = FileInputStream::open(it->path, ec);
+      if (!it->file) {
+        break;
+      }
+    }
+
+    const uint64_t position = offset + total - it->offset;
+    const size_t wanted =
+        static_cast<size_t>(min<uint64_t>(buffer.size() - total, it->size - position));
+    const size_t count = it->file->read(position, buffer.subspan(total, wanted));
+    total += count;
+
+    // volumes shorter than when the stream was created
+    if (count < wanted) {
+      break;
+    }
+  }
+
+  return total;
+}
@@ -0,0 +1,85 @@
+#ifndef VOLUMES_H
+#define VOLUMES_H
+
+#include "archive.h"
+#include "inputstreams.h"
+
+#include <filesystem>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+/// volumes of an archive spread over several files
+struct VolumeSet
+{
+  enum class Kind
+  {
+    // a single file
+    NONE,
+
+    // the archive cut in numbered pieces (name.7z.001, name.7z.002, ...), that can
+    // be read as if they were concatenated
+    SPLIT,
+
+    // RAR volumes (name.part1.rar, name.part2.rar, ... or name.rar, name.r00, ...),
+    // each with headers of its own, that only 7z can read across
+    RAR
+  };
+
+  Kind kind = Kind::NONE;
+
+  // paths of the volumes in order, starting with the first one
+  std::vector<std::filesystem::path> paths;
+
+  /**
+   * @brief Find the volumes of the archive starting with the given file.
+   *
+   * Only the names of the files are looked at. A file that is not the first volume of
+   * a set, or the only one, is a single file.
+   */
+  static VolumeSet find(std::filesystem::path const& firstVolume);
+};
+
+/**
+ * InputStream over the volumes of a split archive, read as if they were concatenated.
+ *
+ * The sizes of the volumes are read when the stream is created, but each volume is
+ * only opened when a read first reaches it.
+ */
+class VolumeInputStream : public InputStream
+{
+public:
+  /**
+   * @brief Create a stream over the given volumes.
+   *
+   * @return the stream, or a null pointer if the size of a volume could not be read,
+   *   in which case ec is set.
+   */
+  static std::shared_ptr<VolumeInputStream>
+  open(std::vector<std::filesystem::path> const& paths, std::error_code& ec);
+
+  uint64_t size() const override { return m_Size; }
+  std::size_t read(uint64_t offset, std::span<std::byte> buffer) override;
+
+private:
+  struct Volume
+  {
+    std::filesystem::path path;
+
+    // offset of the volume in the stream
+    uint64_t offset = 0;
+    uint64_t size   = 0;
+
+    // opened on the first read
+    std::shared_ptr<FileInputStream> file;
+  };
+
+  VolumeInputStream(std::vector<Volume> volumes, uint64_t size)
+      : m_Volumes(std::move(volumes)), m_Size(size)
+  {}
+
+  std::vector<Volume> m_Volumes;
+  uint64_t m_Size;
+};
+
+#endif  // VOLUMES_H
@@ -0,0 +1,198 @@
+#ifndef WRITEBEHINDQUEUE_H
+#define WRITEBEHINDQUEUE_H
+
+#include "archive.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+ * Hands the data decoded by 7z over to a writer scheduled on an executor, so that
+ * decoding and writing overlap. Chunks are written one at a time and in order.
+ *
+ * The executor may be busy, or even run the caller itself: push() and finish() never
+ * wait for a task that has not started, they write the queued chunks on the calling
+ * thread instead.
+ *
+ * The writer may throw to signal an error, in which case the remaining chunks are
+ * dropped and the next push() fails.
+ */
+template <typename Target>
+class WriteBehindQueue
+{
+public:
+  using Writer = std::function<void(Target&, std::span<const std::byte>)>;
+
+  // maximum amount of data waiting to be written before push() writes it itself
+  static constexpr std::size_t DEFAULT_MAX_PENDING_BYTES = 16 * 1024 * 1024;
+
+  WriteBehindQueue(std::shared_ptr<Executor> executor, Writer writer,
+                   std::size_t maxPendingBytes = DEFAULT_MAX_PENDING_BYTES)
+      : m_Executor(std::move(executor)), m_State(std::make_shared<State>())
+  {
+    m_State->writer          = std::move(writer);
+    m_State->maxPendingBytes = maxPendingBytes;
+  }
+
+  WriteBehindQueue(const WriteBehindQueue&)            = delete;
+  WriteBehindQueue& operator=(const WriteBehindQueue&) = delete;
+
+  ~WriteBehindQueue() { finish(); }
+
+  /**
+   * @brief Queue a copy of the given data to be written to the given target.
+   *
+   * @return false if a previous write failed, true otherwise.
+   */
+  bool push(Target target, const void* data, std::size_t size)
+  {
+    State& state = *m_State;
+
+    std::vector<std::byte> buffer;
+    {
+      std::unique_lock lock(state.mutex);
+      while (!state.error && state.pendingBytes >= state.maxPendingBytes) {
+        if (state.draining) {
+          state.spaceAvailable.wait(lock);
+        } else {
+          drain(state, lock);
+        }
+      }
+      if (state.error) {
+        return false;
+      }
+      if (!state.freeBuffers.empty()) {
+        buffer = std::move(state.freeBuffers.back());
+        state.freeBuffers.pop_back();
+      }
+      state.pendingBytes += size;
+    }
+
+    buffer.resize(size);
+    if (size > 0) {
+      std::memcpy(buffer.data(), data, size);
+    }
+
+    bool submit = false;
+    {
+      std::scoped_lock lock(state.mutex);
+      state.chunks.push_back({std::move(target), std::move(buffer)});
+      submit            = !state.draining && !state.drainQueued;
+      state.drainQueued = state.drainQueued || submit;
+    }
+
+    // the task keeps the state alive, it finds nothing left to write if it starts
+    // after finish()
+    if (submit) {
+      m_Executor->submit([state = m_State] {
+        std::unique_lock lock(state->mutex);
+        state->drainQueued = false;
+        if (!state->draining) {
+          drain(*state, lock);
+        }
+      });
+    }
+    return true;
+  }
+
+  /**
+   * @brief Wait until all the queued chunks have been written.
+   *
+   * @return the error message of the write that failed, if any.
+   */
+  std::optional<std::string> finish()
+  {
+    State& state = *m_State;
+
+    std::unique_lock lock(state.mutex);
+    while (state.draining || !state.chunks.empty()) {
+      if (state.draining) {
+        state.idle.wait(lock);
+      } else {
+        drain(state, lock);
+      }
+    }
+    return state.error;
+  }
+
+  /**
+   * @return the error message of the write that failed, if any.
+   */
+  [[nodiscard]] std::optional<std::string> error() const
+  {
+    std::scoped_lock lock(m_State->mutex);
+    return m_State->error;
+  }
+
+private:
+  struct Chunk
+  {
+    Target target;
+    std::vector<std::byte> data;
+  };
+
+  struct State
+  {
+    Writer writer;
+    std::size_t maxPendingBytes = 0;
+
+    std::mutex mutex;
+    std::condition_variable spaceAvailable;
+    std::condition_variable idle;
+
+    std::deque<Chunk> chunks;
+    std::vector<std::vector<std::byte>> freeBuffers;
+    std::size_t pendingBytes = 0;
+
+    // a thread is writing the chunks, and a drain task has been submitted but has
+    // not started
+    bool draining    = false;
+    bool drainQueued = false;
+
+    std::optional<std::string> error;
+  };
+
+  // write the queued chunks, called with the lock held and not draining
+  static void drain(State& state, std::unique_lock<std::mutex>& lock)
+  {
+    state.draining = true;
+    while (!state.chunks.empty()) {
+      Chunk chunk = std::move(state.chunks.front());
+      state.chunks.pop_front();
+      const bool failed = state.error.has_value();
+      lock.unlock();
+
+      std::optional<std::string> error;
+      if (!failed) {
+        try {
+          state.writer(chunk.target, chunk.data);
+        } catch (const std::exception& ex) {
+          error = ex.what();
+        }
+      }
+
+      lock.lock();
+      if (error && !state.error) {
+        state.error = std::move(error);
+      }
+      state.pendingBytes -= chunk.data.size();
+      chunk.data.clear();
+      state.freeBuffers.push_back(std::move(chunk.data));
+      state.spaceAvailable.notify_all();
+    }
+    state.draining = false;
+    state.idle.notify_all();
+  }
+
+  std::shared_ptr<Executor> m_Executor;
+  std::shared_ptr<State> m_State;
+};
+
+#endif  // WRITEBEHINDQUEUE_H
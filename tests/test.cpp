@@ -2,6 +2,29 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <map>
+#include <new>
+#include <optional>
+#include <thread>
+#include <tuple>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 namespace fs = std::filesystem;
 
@@ -15,6 +38,34 @@ namespace fs = std::filesystem;
 #define NATIVE_STRING(str) L##str
 #endif
 
+// allocations made through operator new while countAllocations is set, see
+// ReopenAllocations
+atomic<bool> countAllocations = false;
+atomic<size_t> allocationCount = 0;
+atomic<size_t> allocatedBytes  = 0;
+
+void* operator new(size_t size)
+{
+  if (countAllocations) {
+    ++allocationCount;
+    allocatedBytes += size;
+  }
+  if (void* p = malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  free(p);
+}
+
 struct TemporaryDir
 {
   TemporaryDir() : path(fs::temp_directory_path() / "mo2-archive-test")
@@ -55,6 +106,8 @@ native_string errorCodeToString(Archive::Error e)
     return NATIVE_STRING("Error: Archive invalid");
   case Archive::Error::ERROR_OUT_OF_MEMORY:
     return NATIVE_STRING("Error: Out of memory");
+  case Archive::Error::ERROR_INVALID_OUTPUT_MAPPING:
+    return NATIVE_STRING("Error: Invalid output mapping");
   default:
     return NATIVE_STRING("ERROR: INVALID ERROR CODE!");
   }
@@ -105,9 +158,108 @@ INSTANTIATE_TEST_SUITE_P(Extract, ArchiveTest,
                                          "test_encrypted_headers.7z", "test.rar",
                                          "test.zip", "test_encrypted.zip"));
 
-// INSTANTIATE_TEST_SUITE_P(ExtractNested, ArchiveTest,
-//                          testing::Values("test.tar.bz2",
-//                                          "test.tar.zst"));
+// test.tar.zst needs a 7z built with zstd, which the one from vcpkg is not
+INSTANTIATE_TEST_SUITE_P(ExtractNested, ArchiveTest, testing::Values("test.tar.bz2"));
+
+TEST(ArchiveTest, Tarball)
+{
+  INIT("test.tar.bz2");
+
+  // the entries of the tar archive rather than the single compressed item
+  map<fs::path, bool> entries;
+  for (FileData* file : a->getFileList()) {
+    entries.emplace(file->getArchiveFilePath(), file->isDirectory());
+  }
+  const map<fs::path, bool> expected{{"test", true},
+                                     {fs::path("test") / "b.txt", false},
+                                     {"a.txt", false},
+                                     {"c.txt", false}};
+  EXPECT_EQ(entries, expected);
+
+  vector<vector<std::byte>> buffers;
+  ASSERT_TRUE(a->extractToMemory(a->getFileList(), buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    EXPECT_EQ(buffers[i].size(), a->getFileList()[i]->getSize());
+  }
+}
+
+TEST(ArchiveTest, TarballLinks)
+{
+  INIT("test_links.tar.bz2");
+
+  // the symbolic link to a.txt would only be an empty file, and is reported
+  vector<native_string> warnings;
+  a->setLogCallback([&](Archive::LogLevel level, native_string const& log) {
+    if (level == Archive::LogLevel::Warning) {
+      warnings.push_back(log);
+    }
+  });
+  ASSERT_TRUE(a->open("files/test_links.tar.bz2", nullptr))
+      << errorCodeToString(a->getLastError());
+  ASSERT_EQ(warnings.size(), 1u);
+  EXPECT_NE(warnings[0].find(NATIVE_STRING("soft.txt")), native_string::npos);
+
+  // the hard link has the content of a.txt
+  const auto& files = a->getFileList();
+  ASSERT_EQ(files.size(), 3u);
+  EXPECT_EQ(files[0]->getArchiveFilePath(), "a.txt");
+  EXPECT_EQ(files[1]->getArchiveFilePath(), "hard.txt");
+  EXPECT_EQ(files[2]->getArchiveFilePath(), "b.txt");
+  EXPECT_EQ(files[1]->getSize(), 5u);
+
+  auto toString = [](vector<std::byte> const& buffer) {
+    return string(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+  };
+
+  vector<vector<std::byte>> buffers;
+  ASSERT_TRUE(a->extractToMemory(files, buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+  ASSERT_EQ(buffers.size(), 3u);
+  EXPECT_EQ(toString(buffers[0]), "hello");
+  EXPECT_EQ(toString(buffers[1]), "hello");
+  EXPECT_EQ(toString(buffers[2]), "world!");
+
+  // and can be extracted on its own
+  ASSERT_TRUE(a->extractToMemory(vector<FileData*>{files[1]}, buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+  ASSERT_EQ(buffers.size(), 1u);
+  EXPECT_EQ(toString(buffers[0]), "hello");
+}
+
+// paths_overflow.tar.bz2 holds 4000 entries with paths of 1.1 MB, more than the 4 GiB
+// the paths of an archive can take; decoding it takes as much memory, so run it with
+//   archive-test --gtest_also_run_disabled_tests --gtest_filter=*PathsOverflow
+TEST(ArchiveTest, DISABLED_PathsOverflow)
+{
+  auto a = CreateArchive();
+  ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+  a->setLogCallback(logCallback);
+
+  // reported as an error rather than thrown
+  EXPECT_FALSE(a->open("files/paths_overflow.tar.bz2", nullptr));
+  EXPECT_NE(a->getLastError(), Archive::Error::ERROR_NONE);
+  EXPECT_TRUE(a->getFileList().empty());
+
+  ASSERT_TRUE(a->open("files/test.7z", nullptr))
+      << errorCodeToString(a->getLastError());
+  EXPECT_FALSE(a->getFileList().empty());
+}
+
+// see PathsOverflow
+TEST(ArchiveTest, DISABLED_ListArchivesPathsOverflow)
+{
+  const vector<fs::path> paths{"files/paths_overflow.tar.bz2", "files/test.7z"};
+  const auto listings = ListArchives(paths);
+  ASSERT_EQ(listings.size(), paths.size());
+
+  // the error ends up in the listing, and the other archive is listed
+  EXPECT_NE(listings[0].error, Archive::Error::ERROR_NONE);
+  EXPECT_FALSE(listings[0].errorMessage.empty());
+  EXPECT_TRUE(listings[0].entries.empty());
+  EXPECT_EQ(listings[1].error, Archive::Error::ERROR_NONE) << listings[1].errorMessage;
+  EXPECT_FALSE(listings[1].entries.empty());
+}
 
 TEST(ArchiveTest, NoOutputPaths)
 {
@@ -125,6 +277,401 @@ TEST(ArchiveTest, NoOutputPaths)
   ASSERT_EQ(count, 0) << "Error: output directory is not empty";
 }
 
+TEST(ArchiveTest, PasswordOnlyAskedWhenNeeded)
+{
+  TemporaryDir tmpDir;
+  ASSERT_TRUE(tmpDir.isValid()) << tmpDir.errorString();
+
+  const fs::path invalid = tmpDir.path / "invalid.7z";
+  ofstream(invalid, ios::binary) << "not an archive";
+
+  // a valid signature, but headers past the end of the file
+  const fs::path truncated = tmpDir.path / "truncated.7z";
+  fs::copy_file("files/test.7z", truncated);
+  fs::resize_file(truncated, fs::file_size(truncated) / 2);
+
+  int calls                            = 0;
+  Archive::PasswordCallback countCalls = [&] {
+    ++calls;
+    return passwordCallback();
+  };
+
+  auto a = CreateArchive();
+  ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+  a->setLogCallback(logCallback);
+
+  ASSERT_TRUE(a->open("files/test.7z", countCalls))
+      << errorCodeToString(a->getLastError());
+  EXPECT_EQ(calls, 0);
+
+  EXPECT_FALSE(a->open(invalid, countCalls));
+  EXPECT_EQ(calls, 0);
+
+  EXPECT_FALSE(a->open(truncated, countCalls));
+  EXPECT_EQ(calls, 0);
+
+  ASSERT_TRUE(a->open("files/test_encrypted_headers.7z", countCalls))
+      << errorCodeToString(a->getLastError());
+  EXPECT_EQ(calls, 1);
+  EXPECT_FALSE(a->getFileList().empty());
+}
+
+TEST(ArchiveTest, FormatDetection)
+{
+  TemporaryDir tmpDir;
+  ASSERT_TRUE(tmpDir.isValid()) << tmpDir.errorString();
+
+  // the signature wins over a wrong extension
+  const fs::path renamed = tmpDir.path / "renamed.zip";
+  error_code ec;
+  fs::copy_file("files/test.7z", renamed, ec);
+  ASSERT_FALSE(ec) << ec.message();
+
+  auto a = CreateArchive();
+  ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+  a->setLogCallback(logCallback);
+
+  ASSERT_TRUE(a->open("files/test.7z", nullptr))
+      << errorCodeToString(a->getLastError());
+  const size_t count = a->getFileList().size();
+
+  ASSERT_TRUE(a->open(renamed, nullptr)) << errorCodeToString(a->getLastError());
+  EXPECT_EQ(a->getFileList().size(), count);
+
+  // the format cached for the file is wrong once it is replaced, which is not a reason
+  // to ask for a password
+  int calls                            = 0;
+  Archive::PasswordCallback countCalls = [&] {
+    ++calls;
+    return passwordCallback();
+  };
+  fs::copy_file("files/test.zip", renamed, fs::copy_options::overwrite_existing, ec);
+  ASSERT_FALSE(ec) << ec.message();
+  ASSERT_TRUE(a->open(renamed, countCalls)) << errorCodeToString(a->getLastError());
+  EXPECT_FALSE(a->getFileList().empty());
+  EXPECT_EQ(calls, 0);
+
+  // but the replacement may need one
+  fs::copy_file("files/test_encrypted_headers.7z", renamed,
+                fs::copy_options::overwrite_existing, ec);
+  ASSERT_FALSE(ec) << ec.message();
+  ASSERT_TRUE(a->open(renamed, countCalls)) << errorCodeToString(a->getLastError());
+  EXPECT_FALSE(a->getFileList().empty());
+  EXPECT_EQ(calls, 1);
+}
+
+TEST(ArchiveTest, ReopenAllocations)
+{
+  auto a = CreateArchive();
+  ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+  a->setLogCallback(logCallback);
+
+  // bytes and number of allocations made by opening test.7z and reading its paths
+  auto measure = [&] {
+    allocationCount  = 0;
+    allocatedBytes   = 0;
+    countAllocations = true;
+    const bool opened = a->open("files/test.7z", nullptr);
+    for (FileData* file : a->getFileList()) {
+      file->getArchiveFilePathView();
+    }
+    countAllocations = false;
+
+    EXPECT_TRUE(opened) << errorCodeToString(a->getLastError());
+    return pair<size_t, size_t>(allocatedBytes, allocationCount);
+  };
+
+  const auto [firstBytes, firstCount] = measure();
+  if (firstCount == 0) {
+    GTEST_SKIP() << "the allocations of the library are not seen by the test";
+  }
+  const auto [secondBytes, secondCount] = measure();
+  const auto [thirdBytes, thirdCount]   = measure();
+
+  // the 256 KiB read buffer is only allocated by the first open
+  EXPECT_GE(firstBytes, secondBytes + 256 * 1024);
+  EXPECT_LE(secondCount, firstCount);
+
+  // and reopening does not allocate more each time
+  EXPECT_LE(thirdBytes, secondBytes);
+  EXPECT_LE(thirdCount, secondCount);
+}
+
+TEST(ArchiveTest, ArchivePool)
+{
+  auto pool = CreateArchivePool(1);
+
+  Archive* first = nullptr;
+  size_t count   = 0;
+  {
+    auto a = pool->acquire();
+    ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+    a->setLogCallback(logCallback);
+    ASSERT_TRUE(a->open("files/test.7z", nullptr))
+        << errorCodeToString(a->getLastError());
+    count = a->getFileList().size();
+    first = a.get();
+  }
+  EXPECT_EQ(pool->idleCount(), 1u);
+
+  // the same archive comes back closed, and opens archives again
+  auto a = pool->acquire();
+  EXPECT_EQ(a.get(), first);
+  EXPECT_EQ(pool->idleCount(), 0u);
+  EXPECT_TRUE(a->getFileList().empty());
+
+  ASSERT_TRUE(a->open("files/test.zip", nullptr))
+      << errorCodeToString(a->getLastError());
+  EXPECT_FALSE(a->getFileList().empty());
+  ASSERT_TRUE(a->open("files/test.7z", nullptr))
+      << errorCodeToString(a->getLastError());
+  EXPECT_EQ(a->getFileList().size(), count);
+
+  vector<vector<std::byte>> buffers;
+  EXPECT_TRUE(a->extractToMemory(a->getFileList(), buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+
+  // only one archive is kept
+  auto b = pool->acquire();
+  EXPECT_NE(b.get(), a.get());
+  a.reset();
+  b.reset();
+  EXPECT_EQ(pool->idleCount(), 1u);
+}
+
+TEST(ArchiveTest, ListArchives)
+{
+  const vector<fs::path> paths{"files/test.7z", "files/missing.7z", "files/test.zip",
+                               "files/test_encrypted_headers.7z"};
+  const auto listings = ListArchives(paths);
+  ASSERT_EQ(listings.size(), paths.size());
+
+  for (size_t i = 0; i < paths.size(); ++i) {
+    EXPECT_EQ(listings[i].archivePath, paths[i]);
+  }
+
+  // archives that cannot be listed do not stop the others
+  EXPECT_NE(listings[1].error, Archive::Error::ERROR_NONE);
+  EXPECT_TRUE(listings[1].entries.empty());
+  EXPECT_NE(listings[3].error, Archive::Error::ERROR_NONE);
+
+  for (size_t i : {0u, 2u}) {
+    auto a = CreateArchive();
+    ASSERT_TRUE(a->open(paths[i], nullptr)) << errorCodeToString(a->getLastError());
+
+    const auto& listing = listings[i];
+    EXPECT_EQ(listing.error, Archive::Error::ERROR_NONE) << listing.errorMessage;
+    ASSERT_EQ(listing.entries.size(), a->getFileList().size());
+    for (size_t j = 0; j < listing.entries.size(); ++j) {
+      const FileData* file = a->getFileList()[j];
+      EXPECT_EQ(listing.path(listing.entries[j]), file->getArchiveFilePathView());
+      EXPECT_EQ(listing.entries[j].size, file->getSize());
+      EXPECT_EQ(listing.entries[j].isDirectory, file->isDirectory());
+    }
+  }
+
+  // listings are streamed to the callback as they are completed
+  vector<size_t> indices;
+  ListArchives(paths, [&](size_t index, ArchiveListing&& listing) {
+    EXPECT_EQ(listing.archivePath, paths[index]);
+    indices.push_back(index);
+  });
+  ranges::sort(indices);
+  EXPECT_EQ(indices, (vector<size_t>{0, 1, 2, 3}));
+}
+
+TEST(ArchiveTest, ListArchivesOnBusyExecutor)
+{
+  const vector<fs::path> paths{"files/test.7z", "files/test.zip", "files/test.7z",
+                               "files/test.zip"};
+  const auto expected = ListArchives(paths);
+
+  // the only thread of the executor runs ListArchives(), so neither its own tasks nor
+  // the prefetching tasks of the archives can run until it returns
+  ListArchivesOptions options;
+  options.executor                       = CreateThreadPoolExecutor(1);
+  options.openOptions.inputMode          = Archive::InputMode::PREFETCHED;
+  options.openOptions.prefetchWindowSize = 64;
+
+  promise<vector<ArchiveListing>> listed;
+  options.executor->submit([&] {
+    listed.set_value(ListArchives(paths, options));
+  });
+
+  auto result = listed.get_future();
+  ASSERT_EQ(result.wait_for(30s), future_status::ready);
+  const auto listings = result.get();
+  ASSERT_EQ(listings.size(), paths.size());
+  for (size_t i = 0; i < paths.size(); ++i) {
+    EXPECT_EQ(listings[i].error, Archive::Error::ERROR_NONE)
+        << listings[i].errorMessage;
+    EXPECT_FALSE(listings[i].entries.empty());
+    EXPECT_EQ(listings[i].paths, expected[i].paths);
+  }
+}
+
+// executor keeping its tasks without running them until told to
+class StalledExecutor : public Executor
+{
+public:
+  void submit(Task task) override { tasks.push_back(std::move(task)); }
+  size_t concurrency() const override { return 4; }
+
+  vector<Task> tasks;
+};
+
+TEST(ArchiveTest, ListArchivesWithStalledExecutor)
+{
+  const vector<fs::path> paths{"files/test.7z", "files/test.zip", "files/test.rar"};
+
+  // the calling thread lists every archive itself
+  auto executor = make_shared<StalledExecutor>();
+  ListArchivesOptions options;
+  options.executor = executor;
+
+  const auto listings = ListArchives(paths, options);
+  ASSERT_EQ(listings.size(), paths.size());
+  for (const auto& listing : listings) {
+    EXPECT_EQ(listing.error, Archive::Error::ERROR_NONE) << listing.errorMessage;
+    EXPECT_FALSE(listing.entries.empty());
+  }
+
+  // the tasks run late find nothing left to list
+  EXPECT_FALSE(executor->tasks.empty());
+  for (auto& task : executor->tasks) {
+    task();
+  }
+  executor->tasks.clear();
+}
+
+TEST(ArchiveTest, SplitVolumes)
+{
+  TemporaryDir tmpDir;
+  ASSERT_TRUE(tmpDir.isValid()) << tmpDir.errorString();
+
+  // cut the archive in three pieces
+  ifstream ifs("files/test.7z", ios::binary);
+  const vector<char> content{istreambuf_iterator<char>(ifs), {}};
+  ASSERT_GT(content.size(), 3u);
+
+  const size_t pieceSize = content.size() / 3 + 1;
+  for (size_t i = 0; i * pieceSize < content.size(); ++i) {
+    ofstream ofs(tmpDir.path / ("test.7z.00" + to_string(i + 1)), ios::binary);
+    ofs.write(content.data() + i * pieceSize,
+              static_cast<streamsize>(min(pieceSize, content.size() - i * pieceSize)));
+  }
+
+  auto reference = CreateArchive();
+  ASSERT_TRUE(reference->isValid()) << errorCodeToString(reference->getLastError());
+  ASSERT_TRUE(reference->open("files/test.7z", nullptr))
+      << errorCodeToString(reference->getLastError());
+
+  auto a = CreateArchive();
+  a->setLogCallback(logCallback);
+  ASSERT_TRUE(a->open(tmpDir.path / "test.7z.001", nullptr))
+      << errorCodeToString(a->getLastError());
+  ASSERT_EQ(a->getFileList().size(), reference->getFileList().size());
+
+  vector<vector<std::byte>> buffers, referenceBuffers;
+  EXPECT_TRUE(a->extractToMemory(a->getFileList(), buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+  EXPECT_TRUE(reference->extractToMemory(reference->getFileList(), referenceBuffers,
+                                         errorCallback))
+      << errorCodeToString(reference->getLastError());
+  EXPECT_EQ(buffers, referenceBuffers);
+}
+
+// the same RAR volumes named name.part1.rar, ... (RAR 5) and name.rar, name.r00, ...
+// (RAR 4), a.txt being in the first one, c.txt in the last one and big.bin in all three
+class RarVolumesTest : public testing::TestWithParam<array<const char*, 3>>
+{
+protected:
+  void SetUp() override
+  {
+    ASSERT_TRUE(tmpDir.isValid()) << tmpDir.errorString();
+    for (const char* name : GetParam()) {
+      error_code ec;
+      fs::copy_file(fs::path("files") / name, tmpDir.path / name, ec);
+      ASSERT_FALSE(ec) << ec.message();
+    }
+
+    a = CreateArchive();
+    ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+    a->setLogCallback(logCallback);
+  }
+
+  static string bigContent()
+  {
+    string content(3000, '\0');
+    for (size_t i = 0; i < content.size(); ++i) {
+      content[i] = static_cast<char>((i * 7 + 3 + i / 251) % 256);
+    }
+    return content;
+  }
+
+  TemporaryDir tmpDir;
+  unique_ptr<Archive> a;
+};
+
+TEST_P(RarVolumesTest, ListAndExtract)
+{
+  ASSERT_TRUE(a->open(tmpDir.path / GetParam()[0], nullptr))
+      << errorCodeToString(a->getLastError());
+
+  const auto& files = a->getFileList();
+  map<fs::path, uint64_t> sizes;
+  for (FileData* file : files) {
+    sizes[file->getArchiveFilePath()] = file->getSize();
+  }
+  EXPECT_EQ(sizes, (map<fs::path, uint64_t>{
+                       {"a.txt", 5}, {"big.bin", 3000}, {"c.txt", 6}}));
+
+  vector<vector<std::byte>> buffers;
+  ASSERT_TRUE(a->extractToMemory(files, buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+  map<fs::path, string> contents;
+  for (size_t i = 0; i < files.size(); ++i) {
+    contents[files[i]->getArchiveFilePath()] =
+        string(reinterpret_cast<const char*>(buffers[i].data()), buffers[i].size());
+  }
+  EXPECT_EQ(contents, (map<fs::path, string>{{"a.txt", "hello"},
+                                             {"big.bin", bigContent()},
+                                             {"c.txt", "world!"}}));
+}
+
+TEST_P(RarVolumesTest, MissingVolume)
+{
+  // without the second volume, the first one is opened on its own
+  error_code ec;
+  fs::remove(tmpDir.path / GetParam()[1], ec);
+  ASSERT_FALSE(ec) << ec.message();
+  ASSERT_TRUE(a->open(tmpDir.path / GetParam()[0], nullptr))
+      << errorCodeToString(a->getLastError());
+
+  FileData* small = a->findEntry("a.txt", Archive::PathMatch::EXACT);
+  FileData* big   = a->findEntry("big.bin", Archive::PathMatch::EXACT);
+  ASSERT_NE(small, nullptr);
+  ASSERT_NE(big, nullptr);
+  EXPECT_EQ(a->findEntry("c.txt", Archive::PathMatch::EXACT), nullptr);
+
+  vector<vector<std::byte>> buffers;
+  ASSERT_TRUE(a->extractToMemory(vector<FileData*>{small}, buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+  EXPECT_EQ(buffers[0].size(), 5u);
+
+  // the rest of big.bin is in the missing volume
+  EXPECT_FALSE(a->extractToMemory(vector<FileData*>{big}, buffers, nullptr));
+  EXPECT_NE(a->getLastError(), Archive::Error::ERROR_NONE);
+}
+
+const array<const char*, 3> newVolumeNames{
+    "test_volumes.part1.rar", "test_volumes.part2.rar", "test_volumes.part3.rar"};
+const array<const char*, 3> oldVolumeNames{
+    "test_volumes_old.rar", "test_volumes_old.r00", "test_volumes_old.r01"};
+
+INSTANTIATE_TEST_SUITE_P(Names, RarVolumesTest,
+                         testing::Values(newVolumeNames, oldVolumeNames));
+
 TEST(ArchiveTest, FileChangeCallback)
 {
   INIT("test.7z");
@@ -163,3 +710,950 @@ TEST(ArchiveTest, FileChangeCallback)
   }
   ASSERT_EQ(count, 1);
 }
+
+TEST(ArchiveTest, OutputMapping)
+{
+  INIT("test.7z");
+
+  const auto& files = a->getFileList();
+  OutputMapping mapping;
+  for (uint32_t i = 0; i < files.size(); ++i) {
+    mapping.add(i, (fs::path("out") / files[i]->getArchiveFilePath()).native());
+  }
+
+  // paths come back as they were added
+  vector<pair<uint32_t, native_string>> paths;
+  mapping.forEach([&](uint32_t index, native_string_view path) {
+    paths.emplace_back(index, path);
+  });
+  ASSERT_EQ(paths.size(), files.size());
+  for (uint32_t i = 0; i < files.size(); ++i) {
+    EXPECT_EQ(paths[i].first, i);
+    EXPECT_EQ(fs::path(paths[i].second),
+              fs::path("out") / files[i]->getArchiveFilePath());
+  }
+
+  ASSERT_TRUE(a->extract(tmpDir.path, mapping, nullptr, nullptr, errorCallback))
+      << errorCodeToString(a->getLastError());
+
+  for (FileData* file : files) {
+    const fs::path path = tmpDir.path / "out" / file->getArchiveFilePath();
+    if (file->isDirectory()) {
+      EXPECT_TRUE(fs::is_directory(path)) << path;
+    } else {
+      EXPECT_EQ(fs::file_size(path), file->getSize()) << path;
+    }
+  }
+
+  // invalid mappings are rejected before anything is extracted
+  for (const native_string& path : {native_string(NATIVE_STRING("../escape.txt")),
+                                    native_string(NATIVE_STRING("/absolute.txt"))}) {
+    OutputMapping invalid;
+    invalid.add(0, path);
+    EXPECT_FALSE(
+        a->extract(tmpDir.path / "invalid", invalid, nullptr, nullptr, nullptr));
+    EXPECT_EQ(a->getLastError(), Archive::Error::ERROR_INVALID_OUTPUT_MAPPING);
+  }
+
+  OutputMapping outOfRange;
+  outOfRange.add(static_cast<uint32_t>(files.size()), NATIVE_STRING("a.txt"));
+  EXPECT_FALSE(
+      a->extract(tmpDir.path / "invalid", outOfRange, nullptr, nullptr, nullptr));
+  EXPECT_FALSE(fs::exists(tmpDir.path / "invalid"));
+}
+
+TEST(ArchiveTest, PathRules)
+{
+  INIT("test.7z");
+
+  native_string error;
+  const vector<PathRule> invalid{
+      {PathRule::Action::MAP, NATIVE_STRING("a**"), NATIVE_STRING("b")}};
+  EXPECT_EQ(CompilePathRules(invalid, Archive::PathMatch::EXACT, error), nullptr);
+  EXPECT_FALSE(error.empty());
+
+  const vector<PathRule> rules{
+      {PathRule::Action::SKIP, NATIVE_STRING("**/*.exe"), {}},
+      {PathRule::Action::MAP, NATIVE_STRING("TEST/**"), NATIVE_STRING("moved/**")},
+      {PathRule::Action::MAP, NATIVE_STRING("TEST"), {}}};
+  const auto compiled =
+      CompilePathRules(rules, Archive::PathMatch::CASE_INSENSITIVE, error);
+  ASSERT_NE(compiled, nullptr) << error;
+
+  FileData* entry = a->findEntry("test/b.txt", Archive::PathMatch::EXACT);
+  ASSERT_NE(entry, nullptr);
+  // the directory is mapped to an empty path, so neither selected nor mapped
+  EXPECT_EQ(a->selectEntries(*compiled), vector<FileData*>{entry});
+
+  const OutputMapping mapping = a->mapEntries(*compiled);
+  ASSERT_EQ(mapping.size(), 1u);
+  ASSERT_TRUE(a->extract(tmpDir.path, mapping, nullptr, nullptr, errorCallback))
+      << errorCodeToString(a->getLastError());
+  EXPECT_EQ(fs::file_size(tmpDir.path / "moved" / "b.txt"), 5u);
+}
+
+TEST(ArchiveTest, PathRulesPatterns)
+{
+  native_string error;
+  auto compile = [&](native_string_view pattern, native_string_view replacement,
+                     Archive::PathMatch match) {
+    const vector<PathRule> rules{{PathRule::Action::MAP, native_string(pattern),
+                                  native_string(replacement)}};
+    return CompilePathRules(rules, match, error);
+  };
+
+  // the same buffers are used for every path, whatever the rules
+  PathRules::Buffers buffers;
+  auto apply = [&](PathRules const& rules,
+                   native_string_view path) -> optional<native_string> {
+    native_string output;
+    if (rules.apply(path, output, buffers) != PathRules::Result::MAPPED) {
+      return nullopt;
+    }
+    return output;
+  };
+
+  // '*' and '?' captures, used in order by kind
+  const auto wildcards = compile(NATIVE_STRING("mods/*/v?.esp"),
+                                 NATIVE_STRING("*_?.esp"), Archive::PathMatch::EXACT);
+  ASSERT_NE(wildcards, nullptr) << error;
+  EXPECT_EQ(apply(*wildcards, NATIVE_STRING("mods/foo/v1.esp")),
+            NATIVE_STRING("foo_1.esp"));
+  EXPECT_EQ(apply(*wildcards, NATIVE_STRING("mods\\foo\\v2.esp")),
+            NATIVE_STRING("foo_2.esp"));
+  EXPECT_EQ(apply(*wildcards, NATIVE_STRING("mods/foo/bar/v1.esp")), nullopt);
+  EXPECT_EQ(apply(*wildcards, NATIVE_STRING("mods/foo/v12.esp")), nullopt);
+  EXPECT_EQ(apply(*wildcards, NATIVE_STRING("Mods/foo/v1.esp")), nullopt);
+
+  // case-insensitive rules compare folded paths but keep the case of the captures
+  const auto insensitive =
+      compile(NATIVE_STRING("mods/*/v?.esp"), NATIVE_STRING("*_?.esp"),
+              Archive::PathMatch::CASE_INSENSITIVE);
+  ASSERT_NE(insensitive, nullptr) << error;
+  EXPECT_EQ(apply(*insensitive, NATIVE_STRING("MODS/Foo/V1.ESP")),
+            NATIVE_STRING("Foo_1.esp"));
+
+  // the Data directory below any top-level directory
+  const auto data = compile(NATIVE_STRING("*/Data/**"), NATIVE_STRING("**"),
+                            Archive::PathMatch::CASE_INSENSITIVE);
+  ASSERT_NE(data, nullptr) << error;
+  EXPECT_EQ(apply(*data, NATIVE_STRING("Mod-1.0/data/meshes/a.nif")),
+            NATIVE_STRING("meshes/a.nif"));
+  EXPECT_EQ(apply(*data, NATIVE_STRING("Data/meshes/a.nif")), nullopt);
+  EXPECT_EQ(apply(*data, NATIVE_STRING("a/b/Data/meshes/a.nif")), nullopt);
+
+  // strip a single top-level directory, files at the root have none
+  const auto strip = compile(NATIVE_STRING("*/**"), NATIVE_STRING("**"),
+                             Archive::PathMatch::EXACT);
+  ASSERT_NE(strip, nullptr) << error;
+  EXPECT_EQ(apply(*strip, NATIVE_STRING("top/a/b.txt")), NATIVE_STRING("a/b.txt"));
+  EXPECT_EQ(apply(*strip, NATIVE_STRING("top/b.txt")), NATIVE_STRING("b.txt"));
+  EXPECT_EQ(apply(*strip, NATIVE_STRING("b.txt")), nullopt);
+}
+
+TEST(ArchiveTest, PathView)
+{
+  INIT("test.7z");
+
+  for (FileData* file : a->getFileList()) {
+    EXPECT_EQ(file->getArchiveFilePathView(), file->getArchiveFilePath().native());
+  }
+}
+
+// write a tar archive with the given files, for tests needing more entries than the
+// bundled archives have
+void writeTar(fs::path const& path, vector<pair<string, string>> const& files)
+{
+  ofstream ofs(path, ios::binary);
+  for (const auto& [name, content] : files) {
+    array<char, 512> header{};
+    name.copy(header.data(), 99);
+    snprintf(header.data() + 100, 8, "%07o", 0644);
+    snprintf(header.data() + 124, 12, "%011llo",
+             static_cast<unsigned long long>(content.size()));
+    snprintf(header.data() + 136, 12, "%011o", 0);
+    header[156] = '0';
+    memcpy(header.data() + 257, "ustar", 6);
+    memcpy(header.data() + 263, "00", 2);
+
+    // the checksum is computed with its own field filled with spaces
+    memset(header.data() + 148, ' ', 8);
+    unsigned checksum = 0;
+    for (const char c : header) {
+      checksum += static_cast<unsigned char>(c);
+    }
+    snprintf(header.data() + 148, 8, "%06o", checksum);
+
+    ofs.write(header.data(), header.size());
+    ofs.write(content.data(), static_cast<streamsize>(content.size()));
+    const string padding((512 - content.size() % 512) % 512, '\0');
+    ofs.write(padding.data(), static_cast<streamsize>(padding.size()));
+  }
+
+  const string end(1024, '\0');
+  ofs.write(end.data(), static_cast<streamsize>(end.size()));
+}
+
+// archive with more entries than a batch of properties, see EntryTable
+class LargeArchiveTest : public testing::Test
+{
+protected:
+  static constexpr size_t ENTRY_COUNT = 5000;
+
+  void SetUp() override
+  {
+    ASSERT_TRUE(tmpDir.isValid()) << tmpDir.errorString();
+
+    vector<pair<string, string>> files;
+    for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+      files.emplace_back(name(i), content(i));
+    }
+    writeTar(tmpDir.path / "large.tar", files);
+
+    a = CreateArchive();
+    ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+    a->setLogCallback(logCallback);
+    ASSERT_TRUE(a->open(tmpDir.path / "large.tar", nullptr))
+        << errorCodeToString(a->getLastError());
+    ASSERT_EQ(a->getFileList().size(), ENTRY_COUNT);
+  }
+
+  static string name(size_t i)
+  {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "dir%zu/file%04zu.txt", i % 7, i);
+    return buffer;
+  }
+  static string content(size_t i)
+  {
+    return string(i % 13, static_cast<char>('a' + i % 26));
+  }
+
+  // check the properties of the given entry
+  static void check(FileData* file, size_t i)
+  {
+    EXPECT_EQ(file->getArchiveFilePath(), fs::path(name(i)).make_preferred());
+    EXPECT_EQ(file->getSize(), content(i).size());
+    EXPECT_FALSE(file->isDirectory());
+  }
+
+  TemporaryDir tmpDir;
+  unique_ptr<Archive> a;
+};
+
+TEST_F(LargeArchiveTest, BatchBoundaries)
+{
+  // read in reverse so that the last batch, which is not full, is loaded first
+  const auto& files = a->getFileList();
+  for (size_t i : {ENTRY_COUNT - 1, size_t(4096), size_t(4095), size_t(0)}) {
+    check(files[i], i);
+  }
+  for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+    check(files[i], i);
+  }
+}
+
+TEST_F(LargeArchiveTest, ConcurrentReads)
+{
+  // each thread starts in a different place, so that the batches are loaded while
+  // others read them
+  const auto& files = a->getFileList();
+  vector<thread> threads;
+  for (size_t t = 0; t < 8; ++t) {
+    threads.emplace_back([&, t] {
+      for (size_t j = 0; j < ENTRY_COUNT; ++j) {
+        const size_t i = (j + t * ENTRY_COUNT / 8) % ENTRY_COUNT;
+        check(files[i], i);
+        files[i]->getCRC();
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+TEST_F(LargeArchiveTest, ExtractAfterPartialLoad)
+{
+  // only the paths of the second batch are loaded before extracting
+  const auto& files = a->getFileList();
+  check(files[4097], 4097);
+
+  vector<vector<std::byte>> buffers;
+  ASSERT_TRUE(a->extractToMemory(files, buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+  ASSERT_EQ(buffers.size(), ENTRY_COUNT);
+  for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+    const string expected = content(i);
+    ASSERT_EQ(buffers[i].size(), expected.size()) << i;
+    EXPECT_TRUE(equal(expected.begin(), expected.end(), buffers[i].begin(),
+                      [](char c, std::byte b) {
+                        return static_cast<std::byte>(c) == b;
+                      }))
+        << i;
+  }
+}
+
+TEST_F(LargeArchiveTest, ExtractOneBatch)
+{
+  // only the batch of the extracted entry is loaded, the others are read afterwards
+  const auto& files = a->getFileList();
+  vector<FileData*> entries{files[4500]};
+
+  vector<vector<std::byte>> buffers;
+  ASSERT_TRUE(a->extractToMemory(entries, buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+  ASSERT_EQ(buffers.size(), 1u);
+  EXPECT_EQ(buffers[0].size(), content(4500).size());
+
+  for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+    check(files[i], i);
+  }
+}
+
+// resident and peak resident memory of the process in bytes
+pair<size_t, size_t> memoryUsage()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters{};
+  GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+  return {counters.WorkingSetSize, counters.PeakWorkingSetSize};
+#else
+  size_t pages = 0, resident = 0;
+  ifstream("/proc/self/statm") >> pages >> resident;
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return {resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)),
+          static_cast<size_t>(usage.ru_maxrss) * 1024};
+#endif
+}
+
+// listing time and memory of a large archive, run with
+//   archive-test --gtest_also_run_disabled_tests --gtest_filter=*ListingBenchmark
+// on the archive given by MO2_ARCHIVE_BENCHMARK, or on a generated tar archive of
+// 500000 entries
+TEST(ArchiveTest, DISABLED_ListingBenchmark)
+{
+  TemporaryDir tmpDir;
+  ASSERT_TRUE(tmpDir.isValid()) << tmpDir.errorString();
+
+  fs::path path;
+  if (const char* benchmark = getenv("MO2_ARCHIVE_BENCHMARK")) {
+    path = benchmark;
+  } else {
+    path = tmpDir.path / "benchmark.tar";
+    vector<pair<string, string>> files(500000);
+    for (size_t i = 0; i < files.size(); ++i) {
+      files[i].first = "directory" + to_string(i % 100) + "/file" + to_string(i);
+    }
+    writeTar(path, files);
+  }
+
+  const auto [residentBefore, peakBefore] = memoryUsage();
+  const auto start                        = chrono::steady_clock::now();
+
+  auto a = CreateArchive();
+  ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+  ASSERT_TRUE(a->open(path, nullptr)) << errorCodeToString(a->getLastError());
+
+  // touch every entry like a caller building its own index would
+  uint64_t totalSize = 0;
+  for (FileData* file : a->getFileList()) {
+    totalSize += file->getSize() + file->getArchiveFilePathView().size();
+  }
+
+  const auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - start);
+  const auto [residentAfter, peakAfter] = memoryUsage();
+
+  const size_t residentKiB =
+      (residentAfter - min(residentBefore, residentAfter)) / 1024;
+  const size_t peakKiB = max(peakBefore, peakAfter) / 1024;
+
+  cout << a->getFileList().size() << " entries (" << totalSize << ") listed in "
+       << elapsed.count() << " s, resident memory +" << residentKiB << " KiB, peak "
+       << peakKiB << " KiB\n";
+  RecordProperty("entries", static_cast<int>(a->getFileList().size()));
+  RecordProperty("milliseconds", static_cast<int>(elapsed.count() * 1000));
+  RecordProperty("residentKiB", static_cast<int>(residentKiB));
+  RecordProperty("peakKiB", static_cast<int>(peakKiB));
+}
+
+TEST(ArchiveTest, Metadata)
+{
+  INIT("test.7z");
+
+  uint64_t packedSize = 0;
+  for (FileData* file : a->getFileList()) {
+    EXPECT_FALSE(file->isEncrypted());
+    EXPECT_NE(file->getModificationTime(), chrono::system_clock::time_point());
+    packedSize += file->getPackedSize();
+
+    if (!file->isDirectory()) {
+      EXPECT_FALSE(file->getCompressionMethod().empty());
+      EXPECT_NE(file->getBlockIndex(), FileData::NO_BLOCK);
+    }
+  }
+  EXPECT_GT(packedSize, 0u);
+}
+
+TEST(ArchiveTest, PathKeys)
+{
+  INIT("test.7z");
+
+  for (FileData* file : a->getFileList()) {
+    native_string expected =
+        file->getArchiveFilePath().generic_string<native_string::value_type>();
+    ranges::transform(expected, expected.begin(), [](auto c) {
+      return c >= 'A' && c <= 'Z' ? static_cast<decltype(c)>(c - 'A' + 'a') : c;
+    });
+    EXPECT_EQ(file->getPathKey(), expected);
+  }
+
+  EXPECT_TRUE(a->getCaseCollisions().empty());
+}
+
+TEST(ArchiveTest, PathKeysFolding)
+{
+  TemporaryDir tmpDir;
+  ASSERT_TRUE(tmpDir.isValid()) << tmpDir.errorString();
+
+  // paths long enough to be folded by whole registers, and colliding paths
+  writeTar(tmpDir.path / "keys.tar",
+           {{"Some Directory/With MIXED Case/Ä Long Name.TXT", "1"},
+            {"a/B.txt", "2"},
+            {"A/b.txt", "3"},
+            {"Ä.txt", "4"},
+            {"ä.txt", "5"}});
+
+  auto a = CreateArchive();
+  ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+  a->setLogCallback(logCallback);
+  ASSERT_TRUE(a->open(tmpDir.path / "keys.tar", nullptr))
+      << errorCodeToString(a->getLastError());
+  const auto& files = a->getFileList();
+  ASSERT_EQ(files.size(), 5u);
+
+  // non-ASCII letters are folded whatever the locale
+  EXPECT_EQ(files[0]->getPathKey(),
+            NATIVE_STRING("some directory/with mixed case/ä long name.txt"));
+  EXPECT_EQ(files[3]->getPathKey(), NATIVE_STRING("ä.txt"));
+
+  const fs::path query =
+      NATIVE_STRING("\\\\SOME directory\\with mixed CASE\\ä LONG name.txt");
+  EXPECT_EQ(a->findEntry(query, Archive::PathMatch::CASE_INSENSITIVE), files[0]);
+  EXPECT_EQ(a->findEntry(query, Archive::PathMatch::EXACT), nullptr);
+
+  const vector<vector<FileData*>> collisions{{files[1], files[2]},
+                                             {files[3], files[4]}};
+  EXPECT_EQ(a->getCaseCollisions(), collisions);
+}
+
+TEST(ArchiveTest, FindEntry)
+{
+  INIT("test.7z");
+
+  FileData* entry = a->findEntry("test/b.txt", Archive::PathMatch::EXACT);
+  ASSERT_NE(entry, nullptr);
+  EXPECT_EQ(entry->getSize(), 5u);
+
+  EXPECT_EQ(a->findEntry("TEST\\B.txt", Archive::PathMatch::EXACT), nullptr);
+  EXPECT_EQ(a->findEntry("TEST\\B.txt", Archive::PathMatch::CASE_INSENSITIVE), entry);
+  EXPECT_EQ(a->findEntry("missing.txt", Archive::PathMatch::CASE_INSENSITIVE), nullptr);
+
+  const auto entries = a->listPrefix("Test", Archive::PathMatch::CASE_INSENSITIVE);
+  ASSERT_EQ(entries.size(), 1u);
+  EXPECT_EQ(entries[0], entry);
+  EXPECT_TRUE(a->listPrefix("Test", Archive::PathMatch::EXACT).empty());
+  EXPECT_EQ(a->listPrefix("", Archive::PathMatch::EXACT).size(),
+            a->getFileList().size());
+}
+
+TEST(ArchiveTest, Tree)
+{
+  INIT("test.7z");
+
+  const auto& tree = a->getTree();
+  EXPECT_EQ(&tree, &a->getTree());
+  ASSERT_EQ(tree.nodes.size(), a->getFileList().size() + 1);
+
+  const auto& root = tree.nodes[0];
+  EXPECT_EQ(root.fileCount, 3u);
+  EXPECT_EQ(root.size, 15u);
+
+  const ArchiveTree::Node* directory = nullptr;
+  for (uint32_t child = root.firstChild; child != ArchiveTree::NO_NODE;
+       child = tree.nodes[child].nextSibling) {
+    if (tree.nodes[child].name == NATIVE_STRING("test")) {
+      directory = &tree.nodes[child];
+    }
+  }
+  ASSERT_NE(directory, nullptr);
+  EXPECT_TRUE(directory->isDirectory);
+  EXPECT_EQ(directory->fileCount, 1u);
+  EXPECT_EQ(directory->size, 5u);
+}
+
+// runs tasks inline and counts them
+class CountingExecutor : public Executor
+{
+public:
+  void submit(Task task) override
+  {
+    ++submitted;
+    task();
+  }
+  size_t concurrency() const override { return 1; }
+
+  atomic<int> submitted = 0;
+};
+
+TEST(ArchiveTest, CustomExecutor)
+{
+  TemporaryDir tmpDir;
+  ASSERT_TRUE(tmpDir.isValid()) << tmpDir.errorString();
+
+  auto executor = make_shared<CountingExecutor>();
+  auto a        = CreateArchive(executor);
+  ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+  ASSERT_EQ(a->getExecutor(), executor);
+  ASSERT_TRUE(a->open("files/test.7z", passwordCallback))
+      << errorCodeToString(a->getLastError());
+
+  for (FileData* file : a->getFileList()) {
+    file->addOutputFilePath(file->getArchiveFilePath());
+  }
+
+  ASSERT_TRUE(a->extract(tmpDir.path, nullptr, nullptr, errorCallback))
+      << errorCodeToString(a->getLastError());
+  EXPECT_GT(executor->submitted, 0);
+  EXPECT_TRUE(fs::exists(tmpDir.path / "test" / "b.txt"));
+}
+
+TEST(ArchiveTest, ExtractOnBusyExecutor)
+{
+  TemporaryDir tmpDir;
+  ASSERT_TRUE(tmpDir.isValid()) << tmpDir.errorString();
+
+  // the only thread of the executor extracts, so the tasks of the extraction cannot
+  // run until it returns
+  auto executor = CreateThreadPoolExecutor(1);
+  auto a        = CreateArchive(executor);
+  ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+  ASSERT_TRUE(a->open("files/test.7z", passwordCallback))
+      << errorCodeToString(a->getLastError());
+
+  for (FileData* file : a->getFileList()) {
+    file->addOutputFilePath(file->getArchiveFilePath());
+  }
+
+  promise<bool> extracted;
+  executor->submit([&] {
+    extracted.set_value(a->extract(tmpDir.path, nullptr, nullptr, errorCallback));
+  });
+
+  auto result = extracted.get_future();
+  ASSERT_EQ(result.wait_for(30s), future_status::ready);
+  EXPECT_TRUE(result.get()) << errorCodeToString(a->getLastError());
+  EXPECT_TRUE(fs::exists(tmpDir.path / "test" / "b.txt"));
+}
+
+TEST(ArchiveTest, ExtractionLimits)
+{
+  INIT("test.zip");
+
+  Archive::ExtractionLimits limits;
+  limits.writeBytesPerSecond  = 1024 * 1024;
+  limits.decodeBytesPerSecond = 1024 * 1024;
+  limits.lowPriority          = true;
+  a->setExtractionLimits(limits);
+  EXPECT_TRUE(a->getExtractionLimits().lowPriority);
+
+  for (FileData* file : a->getFileList()) {
+    file->addOutputFilePath(file->getArchiveFilePath());
+  }
+
+  ASSERT_TRUE(a->extract(tmpDir.path, nullptr, nullptr, errorCallback))
+      << errorCodeToString(a->getLastError());
+  EXPECT_TRUE(fs::exists(tmpDir.path / "a.txt"));
+  EXPECT_TRUE(fs::exists(tmpDir.path / "test" / "b.txt"));
+}
+
+TEST(ArchiveTest, ExtractionLimitsEnforced)
+{
+  INIT("test.zip");
+
+  uint64_t total = 0;
+  for (FileData* file : a->getFileList()) {
+    file->addOutputFilePath(file->getArchiveFilePath());
+    total += file->getSize();
+  }
+
+  // the limiter starts with a quarter of a second worth of bytes, the rest of the data
+  // has to wait for it to refill
+  constexpr uint64_t rate = 8;
+  ASSERT_GT(total, rate / 4);
+
+  Archive::ExtractionLimits limits;
+  limits.writeBytesPerSecond = rate;
+  a->setExtractionLimits(limits);
+
+  const auto start = chrono::steady_clock::now();
+  ASSERT_TRUE(a->extract(tmpDir.path, nullptr, nullptr, errorCallback))
+      << errorCodeToString(a->getLastError());
+  const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+  const double minimum = static_cast<double>(total - rate / 4) / rate;
+  EXPECT_GE(elapsed.count(), minimum * 0.9);
+}
+
+vector<std::byte> readFile(const fs::path& path)
+{
+  ifstream ifs(path, ios::binary);
+  vector<char> content{istreambuf_iterator<char>(ifs), {}};
+  const auto bytes = as_bytes(span(content));
+  return {bytes.begin(), bytes.end()};
+}
+
+TEST(ArchiveTest, ExtractToMemory)
+{
+  INIT("test.7z");
+
+  vector<FileData*> entries;
+  for (FileData* file : a->getFileList()) {
+    if (!file->isDirectory()) {
+      entries.push_back(file);
+    }
+  }
+  ASSERT_EQ(entries.size(), 3u);
+
+  vector<vector<std::byte>> buffers;
+  ASSERT_TRUE(a->extractToMemory(entries, buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+  ASSERT_EQ(buffers.size(), entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    EXPECT_EQ(buffers[i].size(), entries[i]->getSize());
+  }
+
+  // caller-provided buffers
+  vector<std::byte> storage(entries[0]->getSize());
+  vector<span<std::byte>> spans{storage};
+  ASSERT_TRUE(a->extractToMemory(span(entries).first(1), spans, errorCallback))
+      << errorCodeToString(a->getLastError());
+  EXPECT_EQ(storage, buffers[0]);
+
+  // nothing should have been written to disk
+  EXPECT_TRUE(fs::is_empty(tmpDir.path));
+
+  // the buffers hold the same bytes as the files extracted to disk
+  for (FileData* file : entries) {
+    file->addOutputFilePath(file->getArchiveFilePath());
+  }
+  ASSERT_TRUE(a->extract(tmpDir.path, nullptr, nullptr, errorCallback))
+      << errorCodeToString(a->getLastError());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    EXPECT_EQ(buffers[i], readFile(tmpDir.path / entries[i]->getArchiveFilePath()))
+        << entries[i]->getArchiveFilePath();
+  }
+}
+
+TEST(ArchiveTest, OpenEntry)
+{
+  INIT("test.zip");
+
+  FileData* entry = nullptr;
+  for (FileData* file : a->getFileList()) {
+    if (file->getArchiveFilePath().generic_string() == "c.txt") {
+      entry = file;
+    }
+  }
+  ASSERT_NE(entry, nullptr);
+
+  auto stream = a->openEntry(entry);
+  ASSERT_NE(stream, nullptr) << errorCodeToString(a->getLastError());
+
+  string content;
+  getline(stream->stream(), content);
+  EXPECT_EQ(content, "asdf");
+  EXPECT_FALSE(stream->failed());
+
+  std::byte rest[16];
+  EXPECT_EQ(stream->read(rest), 0u);
+}
+
+TEST(ArchiveTest, OpenEntryWhileStreaming)
+{
+  INIT("test.zip");
+
+  vector<FileData*> entries;
+  for (FileData* file : a->getFileList()) {
+    if (!file->isDirectory()) {
+      entries.push_back(file);
+    }
+  }
+  ASSERT_GE(entries.size(), 2u);
+
+  // the reader cannot decode anything else while the first stream is not read
+  auto first = a->openEntry(entries[0]);
+  ASSERT_NE(first, nullptr) << errorCodeToString(a->getLastError());
+  EXPECT_EQ(a->openEntry(entries[1]), nullptr);
+  EXPECT_EQ(a->getLastError(), Archive::Error::ERROR_LIBRARY_ERROR);
+
+  vector<vector<std::byte>> buffers;
+  EXPECT_FALSE(a->extractToMemory(entries, buffers, nullptr));
+  EXPECT_EQ(a->getLastError(), Archive::Error::ERROR_LIBRARY_ERROR);
+
+  // but it can once the first stream has been read to its end
+  vector<std::byte> content(entries[0]->getSize() + 1);
+  EXPECT_EQ(first->read(content), entries[0]->getSize());
+  auto second = a->openEntry(entries[1]);
+  ASSERT_NE(second, nullptr) << errorCodeToString(a->getLastError());
+
+  // or destroyed
+  second.reset();
+  EXPECT_TRUE(a->extractToMemory(entries, buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+}
+
+TEST(ArchiveTest, Chunks)
+{
+  INIT("test.7z");
+
+  map<FileData*, vector<std::byte>> contents;
+  for (auto const& chunk : a->chunks(errorCallback)) {
+    auto& content = contents[chunk.entry];
+    content.insert(content.end(), chunk.data.begin(), chunk.data.end());
+  }
+  EXPECT_EQ(a->getLastError(), Archive::Error::ERROR_NONE)
+      << errorCodeToString(a->getLastError());
+
+  ASSERT_EQ(contents.size(), a->getFileList().size());
+  for (FileData* file : a->getFileList()) {
+    EXPECT_EQ(contents[file].size(), file->getSize());
+  }
+
+  // stopping early must not block
+  for (auto const& chunk : a->chunks(errorCallback)) {
+    EXPECT_NE(chunk.entry, nullptr);
+    break;
+  }
+}
+
+TEST(ArchiveTest, OutputSinks)
+{
+  INIT("test.zip");
+
+  vector<FileData*> entries;
+  for (FileData* file : a->getFileList()) {
+    file->addOutputFilePath(file->getArchiveFilePath());
+    entries.push_back(file);
+  }
+
+  auto memorySink = CreateMemorySink();
+  auto hashSink   = CreateHashSink();
+  auto teeSink =
+      CreateTeeSink({memorySink, hashSink, CreateDiskSink(tmpDir.path)});
+
+  ASSERT_TRUE(a->extract(entries, *teeSink, nullptr, nullptr, errorCallback))
+      << errorCodeToString(a->getLastError());
+
+  for (FileData* file : entries) {
+    const auto* content = memorySink->content(*file);
+    const auto* hash    = hashSink->hash(*file);
+    ASSERT_NE(content, nullptr);
+    ASSERT_NE(hash, nullptr);
+    EXPECT_EQ(content->size(), file->getSize());
+    EXPECT_EQ(hash->size, file->getSize());
+    if (!file->isDirectory()) {
+      EXPECT_EQ(hash->crc, file->getCRC());
+    }
+  }
+
+  EXPECT_TRUE(fs::exists(tmpDir.path / "test" / "b.txt"));
+}
+
+TEST(ArchiveTest, ListingCache)
+{
+  TemporaryDir tmpDir;
+  ASSERT_TRUE(tmpDir.isValid()) << tmpDir.errorString();
+
+  Archive::OpenOptions options;
+  options.listingCacheDirectory = tmpDir.path / "cache";
+
+  // the first open fills the cache, the second one lists from it
+  using Listing = tuple<fs::path, uint64_t, uint64_t, chrono::system_clock::time_point,
+                        native_string, uint32_t>;
+  vector<Listing> listings[2];
+  for (size_t i = 0; i < 2; ++i) {
+    // the cache logs its hits, and the reading of the archive they deferred
+    size_t hits = 0, reads = 0;
+    auto a      = CreateArchive();
+    ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+    a->setLogCallback([&](Archive::LogLevel level, native_string const& log) {
+      if (level == Archive::LogLevel::Debug) {
+        hits += log.starts_with(NATIVE_STRING("Listed "));
+        reads += log.starts_with(NATIVE_STRING("Reading "));
+      }
+      logCallback(level, log);
+    });
+    ASSERT_TRUE(a->open("files/test.7z", passwordCallback, options))
+        << errorCodeToString(a->getLastError());
+    EXPECT_EQ(hits, i);
+
+    for (FileData* file : a->getFileList()) {
+      listings[i].emplace_back(file->getArchiveFilePath(), file->getSize(),
+                               file->getPackedSize(), file->getModificationTime(),
+                               native_string(file->getCompressionMethod()),
+                               file->getBlockIndex());
+    }
+    EXPECT_EQ(reads, 0u);
+
+    vector<vector<std::byte>> buffers;
+    EXPECT_TRUE(a->extractToMemory(a->getFileList(), buffers, errorCallback))
+        << errorCodeToString(a->getLastError());
+    EXPECT_EQ(reads, i);
+  }
+
+  EXPECT_EQ(listings[0], listings[1]);
+  EXPECT_FALSE(fs::is_empty(options.listingCacheDirectory));
+}
+
+// input stream reading from a buffer
+class BufferInputStream : public InputStream
+{
+public:
+  explicit BufferInputStream(vector<std::byte> data) : m_Data(std::move(data)) {}
+
+  uint64_t size() const override { return m_Data.size(); }
+
+  size_t read(uint64_t offset, span<std::byte> buffer) override
+  {
+    if (offset >= m_Data.size()) {
+      return 0;
+    }
+    const size_t size = min<size_t>(buffer.size(), m_Data.size() - offset);
+    copy_n(m_Data.begin() + static_cast<ptrdiff_t>(offset), size, buffer.begin());
+    return size;
+  }
+
+private:
+  vector<std::byte> m_Data;
+};
+
+class OpenFromMemoryTest : public testing::TestWithParam<string>
+{};
+
+TEST_P(OpenFromMemoryTest, Span)
+{
+  const auto data = readFile("files/" + GetParam());
+  ASSERT_FALSE(data.empty());
+
+  auto a = CreateArchive();
+  ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+  a->setLogCallback(logCallback);
+  ASSERT_TRUE(a->open(span(data), passwordCallback))
+      << errorCodeToString(a->getLastError());
+  EXPECT_FALSE(a->getFileList().empty());
+
+  vector<vector<std::byte>> buffers;
+  EXPECT_TRUE(a->extractToMemory(a->getFileList(), buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+}
+
+TEST_P(OpenFromMemoryTest, Stream)
+{
+  auto stream = make_shared<BufferInputStream>(readFile("files/" + GetParam()));
+
+  auto a = CreateArchive();
+  ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+  a->setLogCallback(logCallback);
+  ASSERT_TRUE(a->open(stream, passwordCallback))
+      << errorCodeToString(a->getLastError());
+  EXPECT_FALSE(a->getFileList().empty());
+
+  vector<vector<std::byte>> buffers;
+  EXPECT_TRUE(a->extractToMemory(a->getFileList(), buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+}
+
+TEST_P(OpenFromMemoryTest, MemoryMapped)
+{
+  auto a = CreateArchive();
+  ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+  a->setLogCallback(logCallback);
+
+  Archive::OpenOptions options;
+  options.inputMode = Archive::InputMode::MEMORY_MAPPED;
+  ASSERT_TRUE(a->open("files/" + GetParam(), passwordCallback, options))
+      << errorCodeToString(a->getLastError());
+  EXPECT_FALSE(a->getFileList().empty());
+
+  vector<vector<std::byte>> buffers;
+  EXPECT_TRUE(a->extractToMemory(a->getFileList(), buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+}
+
+TEST_P(OpenFromMemoryTest, Prefetched)
+{
+  auto a = CreateArchive();
+  ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+  a->setLogCallback(logCallback);
+
+  Archive::OpenOptions options;
+  options.inputMode = Archive::InputMode::PREFETCHED;
+  ASSERT_TRUE(a->open("files/" + GetParam(), passwordCallback, options))
+      << errorCodeToString(a->getLastError());
+  EXPECT_FALSE(a->getFileList().empty());
+
+  vector<vector<std::byte>> buffers;
+  EXPECT_TRUE(a->extractToMemory(a->getFileList(), buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+
+  // the same content as with buffered reads
+  auto b = CreateArchive();
+  ASSERT_TRUE(b->open("files/" + GetParam(), passwordCallback))
+      << errorCodeToString(b->getLastError());
+  vector<vector<std::byte>> expected;
+  ASSERT_TRUE(b->extractToMemory(b->getFileList(), expected, errorCallback))
+      << errorCodeToString(b->getLastError());
+  EXPECT_EQ(buffers, expected);
+}
+
+TEST(ArchiveTest, PrefetchedReadAhead)
+{
+  TemporaryDir tmpDir;
+  ASSERT_TRUE(tmpDir.isValid()) << tmpDir.errorString();
+
+  // an archive spanning many halves of the smallest window, read from start to end
+  vector<pair<string, string>> files;
+  for (size_t i = 0; i < 16; ++i) {
+    files.emplace_back("file" + to_string(i) + ".bin",
+                       string(100 * 1024 + i, static_cast<char>('a' + i)));
+  }
+  const fs::path path = tmpDir.path / "large.tar";
+  writeTar(path, files);
+
+  // tasks run as soon as they are submitted, so every range is read ahead of 7z
+  auto a = CreateArchive(make_shared<CountingExecutor>());
+  ASSERT_TRUE(a->isValid()) << errorCodeToString(a->getLastError());
+  a->setLogCallback(logCallback);
+
+  Archive::OpenOptions options;
+  options.inputMode          = Archive::InputMode::PREFETCHED;
+  options.prefetchWindowSize = 128 * 1024;
+  ASSERT_TRUE(a->open(path, nullptr, options)) << errorCodeToString(a->getLastError());
+  ASSERT_EQ(a->getFileList().size(), files.size());
+
+  vector<vector<std::byte>> buffers;
+  ASSERT_TRUE(a->extractToMemory(a->getFileList(), buffers, errorCallback))
+      << errorCodeToString(a->getLastError());
+  EXPECT_GT(a->getInputStats().prefetchHits, 0u);
+
+  for (size_t i = 0; i < files.size(); ++i) {
+    const auto expected = as_bytes(span(files[i].second));
+    EXPECT_TRUE(ranges::equal(buffers[i], expected)) << files[i].first;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(OpenFromMemory, OpenFromMemoryTest,
+                         testing::Values("test.7z", "test_encrypted_headers.7z",
+                                         "test.zip", "test.rar"));